@@ -0,0 +1,70 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _DS_ASYNC_LOG_H_
+#define _DS_ASYNC_LOG_H_
+
+#include <glib.h>
+
+typedef enum {
+    ASYNC_LOG_ERROR,
+    ASYNC_LOG_WARNING,
+    ASYNC_LOG_INFO,
+    ASYNC_LOG_DEBUG,
+    ASYNC_LOG_FRAME,    /* per frame lines */
+    ASYNC_LOG_MAX
+} AsyncLogLevel;
+
+#define ASYNC_LOG_MAX_ARGS      4
+/* Records in the ring, a power of two */
+#define ASYNC_LOG_RING_SIZE     4096
+
+/* Records with a level above this are not logged */
+extern gint async_log_level;
+
+/* Logs fmt with up to ASYNC_LOG_MAX_ARGS integer arguments. Arguments are stored as
+ * gint64 and fmt is formatted on the log thread, so it must be a string literal and
+ * use G_GINT64_FORMAT conversions. Disabled levels cost one compare. */
+#define ASYNC_LOG(level, fmt, ...) \
+    do { \
+        if (G_UNLIKELY ((gint) (level) <= async_log_level)) { \
+            gint64 _args[] = { 0, ##__VA_ARGS__ }; \
+            async_log_push ((level), (fmt), _args + 1, G_N_ELEMENTS (_args) - 1); \
+        } \
+    } while (0)
+
+/* Starts the thread formatting and writing records to stdout */
+void async_log_init(AsyncLogLevel level);
+
+/* Writes the pending records and stops the log thread, once */
+void async_log_stop(void);
+
+/* Parses a level name, returns ASYNC_LOG_MAX if unknown */
+AsyncLogLevel async_log_level_from_name(const gchar *name);
+
+void async_log_push(AsyncLogLevel level, const gchar *fmt, const gint64 *args, guint num_args);
+
+/* Records dropped because the ring was full */
+guint async_log_get_dropped(void);
+
+#endif //_DS_ASYNC_LOG_H_
@@ -0,0 +1,59 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _DS_BATCH_CONTROLLER_H_
+#define _DS_BATCH_CONTROLLER_H_
+
+#include <gst/gst.h>
+#include <glib.h>
+
+#define BATCH_CONTROLLER_MAX_STREAMS    64
+#define BATCH_CONTROLLER_INTERVAL_MS    1000
+/* Batches at least this full do not need a longer wait */
+#define BATCH_CONTROLLER_FULL_FILL      0.9
+/* Wait in units of the slowest stream's frame interval */
+#define BATCH_CONTROLLER_MARGIN         1.1
+
+typedef struct {
+    guint timeout_us;       /* current batched-push-timeout */
+    gdouble fill;           /* frames per batch over batch-size in the last interval */
+    gdouble min_fps;        /* slowest stream with frames in the last interval */
+    guint active_streams;
+    guint increases;
+    guint decreases;
+} BatchControllerState;
+
+/* Timeouts are kept within [min_timeout_us, max_timeout_us], the latter bounds the
+ * latency added by waiting for a batch */
+void batch_controller_init(guint min_timeout_us, guint max_timeout_us);
+
+/* Watches batches leaving streammux and adjusts its batched-push-timeout every
+ * BATCH_CONTROLLER_INTERVAL_MS on the default main context */
+gboolean batch_controller_attach(GstElement *streammux);
+
+void batch_controller_get_state(BatchControllerState *state);
+
+/* Frames per second of the stream in the last interval */
+gdouble batch_controller_get_stream_fps(guint stream);
+
+#endif //_DS_BATCH_CONTROLLER_H_
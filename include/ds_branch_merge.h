@@ -0,0 +1,51 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _DS_BRANCH_MERGE_H_
+#define _DS_BRANCH_MERGE_H_
+
+#include <gst/gst.h>
+#include <glib.h>
+
+/* Longest time an output batch waits for the branches. A batch missing branch
+ * results after it is dropped and a warning is posted on the bus. */
+#ifndef BRANCH_MERGE_TIMEOUT_US
+#define BRANCH_MERGE_TIMEOUT_US   1000000
+#endif
+
+typedef struct _BranchMerge BranchMerge;
+
+BranchMerge *branch_merge_new(const gchar *name, guint num_branches);
+
+void branch_merge_free(BranchMerge *merge);
+
+/* Marks every batch leaving the element as done by the branch */
+gboolean branch_merge_add_branch(BranchMerge *merge, guint branch, GstElement *element);
+
+/* Holds every batch leaving the element until all branches are done with it */
+gboolean branch_merge_set_output(BranchMerge *merge, GstElement *element);
+
+/* Batches dropped because a branch did not finish them in time */
+guint64 branch_merge_get_dropped(BranchMerge *merge);
+
+#endif //_DS_BRANCH_MERGE_H_
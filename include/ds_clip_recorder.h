@@ -0,0 +1,46 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _DS_CLIP_RECORDER_H_
+#define _DS_CLIP_RECORDER_H_
+
+#include <gst/gst.h>
+#include <glib.h>
+
+/* Clips are written to dir as clip_<n>.mp4. Encoded frames of the last pre_s seconds
+ * are kept, a clip runs from pre_s seconds before the last trigger to post_s seconds
+ * after it. A trigger while a clip is written extends it. */
+void clip_recorder_init(const gchar *dir, guint pre_s, guint post_s);
+
+/* Buffers the H.264 output of parser, which must output byte-stream access units */
+gboolean clip_recorder_attach(GstElement *parser);
+
+/* Starts or extends a clip, callable from any thread */
+void clip_recorder_trigger(const gchar *reason);
+
+guint clip_recorder_get_clips(void);
+
+/* Finishes the clip in progress, called after the main loop stopped */
+void clip_recorder_stop(void);
+
+#endif //_DS_CLIP_RECORDER_H_
@@ -0,0 +1,70 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _DS_DATASET_MINER_H_
+#define _DS_DATASET_MINER_H_
+
+#include <glib.h>
+
+#define DATASET_MINER_MAX_SLOTS         64
+#define DATASET_MINER_CHECKPOINT_FILE   "mining_checkpoint.txt"
+#define DATASET_MINER_VERDICTS_FILE     "verdicts.csv"
+#define DATASET_MINER_SELECTED_FILE     "selected.txt"
+#define DATASET_MINER_FAILED_FILE       "failed.txt"
+
+/* input is a directory, scanned recursively for images and videos, or a file listing
+ * one location per line. Items listed in the checkpoint of output_dir are skipped. */
+gboolean dataset_miner_init(const gchar *input, const gchar *output_dir);
+
+gboolean dataset_miner_is_image(const gchar *item);
+
+/* Assigns the next item to a slot (streammux pad), returns NULL when none is left.
+ * An image is the first of the slot's images and is pushed with pts 0. */
+const gchar *dataset_miner_start_slot(guint slot);
+
+/* Assigns the next item to an image slot if it is an image, pushed with pts by the
+ * slot's source. Returns NULL when the slot's source should end its stream. */
+const gchar *dataset_miner_next_image(guint slot, guint64 pts);
+
+/* Adds the verdict of one frame of the item in the slot. Frames of image slots are
+ * matched to their image by pts. */
+void dataset_miner_record_frame(guint slot, gint frame_num, guint64 pts, guint fp_count, guint tp_count,
+    gboolean selected);
+
+/* Called at the stream EOS of the slot. Writes the verdicts of the item in the slot
+ * and checkpoints it as done, returns TRUE if the slot is free for the next item. */
+gboolean dataset_miner_finish_slot(guint slot);
+
+/* The slot's source failed. Checkpoints its item, or its image being decoded, as
+ * failed. Images pushed behind it go to other slots. The slot is freed by
+ * dataset_miner_finish_slot at its stream EOS. */
+void dataset_miner_fail_slot(guint slot);
+
+/* Items not assigned to a slot yet */
+guint dataset_miner_get_pending(void);
+
+void dataset_miner_print(void);
+
+void dataset_miner_close(void);
+
+#endif //_DS_DATASET_MINER_H_
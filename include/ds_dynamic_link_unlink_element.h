@@ -26,15 +26,31 @@
 #include <gst/gst.h>
 #include <glib.h>
 
+/* Called on the main loop when relinking failed and the previous links were restored.
+ * added tells whether adding (the element is out of the pipeline again) or removing
+ * (the element stays linked) failed. */
+typedef void (*link_unlink_failed_callback)(GstElement *element, gboolean added);
+
 typedef struct {
 
     GstElement *main_element;               /* Element to add and remove dynamically*/
     GstElement *main_prev_element;          /* Element previous to the main element */
-    GstElement *main_prev_prev_element;     /* Element previous to previous element of main element in the pipeline */
+    /* Element previous to previous element of main element in the pipeline, its src pad is
+     * blocked during the swap. NULL blocks the src pad of main_prev_element itself, which
+     * is needed when main_prev_element pushes from its own thread (e.g. queue). */
+    GstElement *main_prev_prev_element;
     GstElement *main_next_element;          /* Element next to main element */
 
+    /* Src pad names of the previous elements. NULL means the src pad currently
+     * linked towards the main element, which also finds request pads (e.g. tee
+     * "src_%u"). Next element's sink pad is taken from the current link, so
+     * request sink pads (e.g. streammux "sink_%u") work as is. */
+    const gchar *main_prev_src_pad_name;
+    const gchar *main_prev_prev_src_pad_name;
+
     GstElement *pipeline;                   /* Pipeline */
     GMainLoop *loop;                        /* Main event loop  */
+    link_unlink_failed_callback failed_cb;  /* Optional */
 
 } LinkUnlinkInfo;
 
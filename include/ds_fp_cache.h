@@ -0,0 +1,49 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _DS_FP_CACHE_H_
+#define _DS_FP_CACHE_H_
+
+#include <glib.h>
+#include "gstnvdsmeta.h"
+
+#define FP_CACHE_MAX_STREAMS    64
+#define FP_CACHE_MAX_ENTRIES    32
+
+/* Box geometry is quantized to cells of cell_px pixels, boxes match when every edge
+ * is within one cell. A cached verdict is reused for revalidate_frames frames and
+ * an entry is dropped once it was not seen for max_age_frames frames. */
+void fp_cache_init(guint cell_px, guint revalidate_frames, guint max_age_frames);
+
+/* Returns TRUE if the box matches a static false positive whose verdict is still valid */
+gboolean fp_cache_lookup(guint stream, gint frame_num, NvOSD_RectParams *rect);
+
+/* Adds or re-validates a static false positive */
+void fp_cache_add_fp(guint stream, gint frame_num, NvOSD_RectParams *rect);
+
+/* Drops a cached false positive which was assessed as true positive */
+void fp_cache_remove(guint stream, NvOSD_RectParams *rect);
+
+void fp_cache_clear_stream(guint stream);
+
+#endif //_DS_FP_CACHE_H_
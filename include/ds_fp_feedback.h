@@ -0,0 +1,60 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _DS_FP_FEEDBACK_H_
+#define _DS_FP_FEEDBACK_H_
+
+#include <gst/gst.h>
+#include <glib.h>
+#include "gstnvdsmeta.h"
+
+/* Custom upstream event carrying one confirmed false positive track. Fields:
+ * "stream" (uint), "object-id" (uint64), "class-id" (int), "frame" (int), "left", "top", "width", "height" (double) */
+#define FP_FEEDBACK_EVENT_NAME      "fpfilter-confirmed-fp"
+
+#define FP_FEEDBACK_MAX_STREAMS     64
+#define FP_FEEDBACK_MAX_TRACKS      64
+
+/* A track is confirmed after confirm_frames consecutive false positive verdicts.
+ * Confirmations are dropped after ttl_frames so the track is assessed again. */
+void fp_feedback_init(guint confirm_frames, guint ttl_frames);
+
+/* Sender side, behind fpfilter. Records the verdict of one tracked object and
+ * sends the confirmation upstream through sink_pad once it is confirmed. */
+void fp_feedback_record_verdict(GstPad *sink_pad, guint stream, gint frame_num, guint64 object_id,
+    gint class_id, NvOSD_RectParams *rect, gboolean is_fp);
+
+/* Receiver side. Takes confirmations arriving at the tracker src pad and drops
+ * detections of confirmed tracks in front of the tracker (by overlap with the
+ * track's last box) and behind it (by object id), of the track's class only.
+ * The last box follows the tracker output. pgie_id selects detections. */
+gboolean fp_feedback_attach_receiver(GstElement *tracker, gint pgie_id);
+
+void fp_feedback_clear_stream(guint stream);
+
+/* Detections dropped in front of and behind the tracker */
+guint fp_feedback_get_dropped(gboolean before_tracker);
+
+guint fp_feedback_get_confirmed(void);
+
+#endif //_DS_FP_FEEDBACK_H_
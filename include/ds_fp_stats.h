@@ -0,0 +1,68 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _DS_FP_STATS_H_
+#define _DS_FP_STATS_H_
+
+#include <gst/gst.h>
+#include <glib.h>
+
+#define FP_STATS_MAX_STREAMS    64
+#define FP_STATS_MAX_CLASSES    8
+#define FP_STATS_MAX_WINDOW_S   60
+/* Detector confidence histogram of assessed objects, bins of 0.1 */
+#define FP_STATS_SCORE_BINS     10
+
+/* Name of the structure of posted element messages */
+#define FP_STATS_MESSAGE_NAME   "fpfilter-stats"
+
+typedef struct {
+    guint frames;
+    guint fp_count;
+    guint tp_count;
+    guint class_fp[FP_STATS_MAX_CLASSES];
+    guint class_tp[FP_STATS_MAX_CLASSES];
+    guint fp_scores[FP_STATS_SCORE_BINS];
+    guint tp_scores[FP_STATS_SCORE_BINS];
+} FpStatsWindow;
+
+/* Statistics are kept over the last window_s seconds in one second buckets */
+void fp_stats_init(guint window_s);
+
+/* Adds the fpfilter counts of one frame */
+void fp_stats_add_frame(guint stream, guint fp_count, guint tp_count);
+
+/* Adds the verdict of one assessed object */
+void fp_stats_add_object(guint stream, gint class_id, gfloat confidence, gboolean is_fp);
+
+/* Sums the window of a stream. Returns FALSE if no frame was counted in it. */
+gboolean fp_stats_get(guint stream, FpStatsWindow *window);
+
+/* Returns a FP_STATS_MESSAGE_NAME structure describing the window of a stream */
+GstStructure *fp_stats_new_structure(guint stream, FpStatsWindow *window);
+
+guint fp_stats_get_window_s(void);
+
+void fp_stats_clear_stream(guint stream);
+
+#endif //_DS_FP_STATS_H_
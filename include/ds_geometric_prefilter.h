@@ -0,0 +1,57 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _DS_GEOMETRIC_PREFILTER_H_
+#define _DS_GEOMETRIC_PREFILTER_H_
+
+#include <glib.h>
+#include "gstnvdsmeta.h"
+
+#define PREFILTER_MAX_CLASSES       64
+#define PREFILTER_MAX_STREAMS       64
+#define PREFILTER_MAX_ROI_POINTS    32
+
+/* Outcome of the pre-filter for one box, in the order the checks are applied */
+typedef enum {
+  PREFILTER_REJECT_SIZE,
+  PREFILTER_REJECT_ASPECT_RATIO,
+  PREFILTER_REJECT_CONFIDENCE,
+  PREFILTER_REJECT_ROI,
+  PREFILTER_PASS_CONFIDENCE,
+  PREFILTER_ASSESS,
+  PREFILTER_RESULT_MAX
+} PrefilterResult;
+
+gboolean prefilter_init(const gchar *cfg_file_path);
+
+/* Removes rejected pgie objects from the frame and gives pass_component_id to
+ * objects which skip the assessors. Other objects are left for the assessors. */
+void prefilter_process_frame(NvDsFrameMeta *frame_meta, gint pgie_id, gint pass_component_id);
+
+guint prefilter_get_count(PrefilterResult result);
+
+const gchar *prefilter_result_name(PrefilterResult result);
+
+void prefilter_print(void);
+
+#endif //_DS_GEOMETRIC_PREFILTER_H_
@@ -0,0 +1,56 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _DS_LATENCY_STATS_H_
+#define _DS_LATENCY_STATS_H_
+
+#include <glib.h>
+
+/* Log-linear histogram: 16 sub-buckets per power of two of nanoseconds,
+ * i.e. values are recorded with at most 6.25% relative error. */
+#define LATENCY_STATS_SUB_BUCKET_BITS   4
+#define LATENCY_STATS_NUM_BUCKETS       (64 << LATENCY_STATS_SUB_BUCKET_BITS)
+
+typedef struct {
+    const gchar *name;                              /* Stage name used in reports */
+    gint buckets[LATENCY_STATS_NUM_BUCKETS];        /* Sample count per bucket */
+    gint count;                                     /* Total sample count */
+    guint64 sum_ns;                                 /* Sum of all samples in nanoseconds */
+    gint max_us;                                    /* Largest sample in microseconds */
+} LatencyStats;
+
+void latency_stats_init(LatencyStats *stats, const gchar *name);
+
+/* Lock-free, safe to call from streaming threads */
+void latency_stats_record(LatencyStats *stats, guint64 duration_ns);
+
+/* Returns the given percentile (0-100) in nanoseconds */
+guint64 latency_stats_percentile(LatencyStats *stats, gdouble percentile);
+
+/* Returns the sum of all samples in nanoseconds */
+guint64 latency_stats_sum(LatencyStats *stats);
+
+void latency_stats_print(LatencyStats *stats);
+
+void latency_stats_reset(LatencyStats *stats);
+
+#endif //_DS_LATENCY_STATS_H_
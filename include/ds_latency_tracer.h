@@ -0,0 +1,48 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _DS_LATENCY_TRACER_H_
+#define _DS_LATENCY_TRACER_H_
+
+#include <gst/gst.h>
+#include <glib.h>
+
+/* Tracing is enabled when this environment variable is set to 1 */
+#define LATENCY_TRACER_ENV    "DS_FPFILTER_LATENCY_TRACE"
+
+void latency_tracer_init(void);
+
+gboolean latency_tracer_is_enabled(void);
+
+/* Stamps every batch leaving the element (e.g. streammux) as its pipeline entry time */
+gboolean latency_tracer_set_origin(GstElement *element);
+
+/* Records sink pad to src pad latency of the element. Elements are identified by name,
+ * so an element which is re-created with the same name keeps its statistics. */
+gboolean latency_tracer_add_element(GstElement *element, const gchar *name);
+
+/* Records end to end latency per stream for batches entering the element (e.g. sink) */
+gboolean latency_tracer_set_end(GstElement *element);
+
+void latency_tracer_print(void);
+
+#endif //_DS_LATENCY_TRACER_H_
@@ -0,0 +1,56 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _DS_LOAD_SHEDDER_H_
+#define _DS_LOAD_SHEDDER_H_
+
+#include <gst/gst.h>
+#include <glib.h>
+
+/* Consecutive late batches before stepping one level down, and consecutive
+ * batches well within budget before stepping one level back up */
+#define LOAD_SHEDDER_DEGRADE_BATCHES    5
+#define LOAD_SHEDDER_RECOVER_BATCHES    100
+
+/* Called on the streaming thread whenever the degradation level changes, with the
+ * shedder lock held, so it must not call load_shedder_reset() */
+typedef void (*load_shedder_callback)(guint level);
+
+/* Levels run from 0 (full work) to num_levels - 1 (cheapest). A batch is late if it
+ * took longer than budget_ms since the origin or a QoS event reported lateness.
+ * budget_ms 0 reacts to QoS events only, which only sinks with sync=TRUE send. */
+void load_shedder_init(guint num_levels, guint budget_ms, load_shedder_callback cb);
+
+/* Stamps every batch leaving the element (e.g. streammux) */
+gboolean load_shedder_set_origin(GstElement *element);
+
+/* Checks batches leaving the element against the budget and watches QoS events
+ * travelling upstream through its src pad */
+gboolean load_shedder_watch(GstElement *element);
+
+guint load_shedder_get_level(void);
+
+/* Back to level 0 without calling the callback */
+void load_shedder_reset(void);
+
+#endif //_DS_LOAD_SHEDDER_H_
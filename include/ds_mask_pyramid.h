@@ -0,0 +1,55 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _DS_MASK_PYRAMID_H_
+#define _DS_MASK_PYRAMID_H_
+
+#include <glib.h>
+
+/* Side of a coarse level cell in mask pixels */
+#define MASK_PYRAMID_CELL   8
+
+/* Segmentation class map with a coarse level of foreground (class > 0) pixel counts */
+typedef struct {
+    const gint *class_map;  /* full resolution level, not owned */
+    guint width;
+    guint height;
+    guint cols;
+    guint rows;
+    guint *counts;
+    guint capacity;
+} MaskPyramid;
+
+/* Builds the coarse level of class_map, the count buffer is reused between frames */
+void mask_pyramid_build(MaskPyramid *pyramid, const gint *class_map, guint width, guint height);
+
+void mask_pyramid_free(MaskPyramid *pyramid);
+
+/* Returns the foreground coverage of the box [x0, x1) x [y0, y1) in map pixels. The
+ * coarse level bounds the coverage; only if the bounds straddle threshold is the box
+ * border counted at full resolution and refined set. The result is on the same side
+ * of threshold as the exact coverage. */
+gdouble mask_pyramid_coverage(MaskPyramid *pyramid, gint x0, gint y0, gint x1, gint y1,
+    gdouble threshold, gboolean *refined);
+
+#endif //_DS_MASK_PYRAMID_H_
@@ -0,0 +1,39 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef _DS_OBJECT_MASK_H_
+#define _DS_OBJECT_MASK_H_
+
+#include <glib.h>
+#include "gstnvdsmeta.h"
+
+/* Builds a frame level segmentation class map of map_width x map_height from the
+ * per object masks a secondary mode (process-mode=2) segmentation assessor attaches
+ * to NvDsObjectMeta, and attaches it to the frame. Frames which already carry a
+ * frame level mask or have no object masks are left untouched. frame_width and
+ * frame_height are the dimensions object boxes refer to, i.e. streammux output.
+ * Returns number of frames which got a mask. */
+guint object_mask_compose_frame_masks(NvDsBatchMeta *batch_meta, guint frame_width, guint frame_height,
+    guint map_width, guint map_height);
+
+#endif //_DS_OBJECT_MASK_H_
@@ -0,0 +1,50 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+
+#ifndef _DS_PENDING_BATCHES_H_
+#define _DS_PENDING_BATCHES_H_
+
+#include <gst/gst.h>
+#include <glib.h>
+
+/* Batches which can be in flight between a stamp and its lookup */
+#define MAX_PENDING_BATCHES     64
+
+/* Ring of batch stamps keyed by PTS, which streammux assigns and downstream elements
+ * keep. The oldest stamp is overwritten when the ring is full. */
+typedef struct {
+    GMutex lock;
+    GstClockTime pts[MAX_PENDING_BATCHES];
+    gint64 time_us[MAX_PENDING_BATCHES];
+    guint next;
+} PendingBatches;
+
+void pending_batches_init(PendingBatches *pending);
+
+void pending_batches_push(PendingBatches *pending, GstClockTime pts, gint64 time_us);
+
+/* Returns stamp of the batch with given pts or 0 if it was not seen */
+gint64 pending_batches_find(PendingBatches *pending, GstClockTime pts);
+
+#endif //_DS_PENDING_BATCHES_H_
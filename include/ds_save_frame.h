@@ -35,4 +35,10 @@ void start_save_frame_task(GAsyncQueue *frames_queue);
 
 void stop_save_frame_task(void);
 
+/* Number of frames handed to the save script so far */
+guint get_saved_frame_count(void);
+
+/* Total time spent saving and uploading frames */
+gdouble get_upload_time_s(void);
+
 #endif //_DS_SAVE_FRAME_H_
@@ -25,7 +25,13 @@
 
 #include "glib.h"
 
-typedef void (*user_prompt_callback)(guchar *msg, guint len);
+/* Environment variables overriding the port and the bind address (default 127.0.0.1) */
+#define USR_PROMPT_PORT_ENV     "DS_APP_USR_PROMPT_PORT"
+#define USR_PROMPT_ADDR_ENV     "DS_APP_USR_PROMPT_ADDR"
+
+/* Returns NULL when the message was handled, else the reason it was rejected,
+ * which is sent back to the client instead of "ok" */
+typedef const gchar *(*user_prompt_callback)(guchar *msg, guint len);
 
 void start_usr_prompt_monitor(user_prompt_callback cb);
 
@@ -28,6 +28,7 @@
 #include <glib.h>
 #include <stdio.h>
 #include <limits.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -35,10 +36,27 @@
 #include <cuda_runtime_api.h>
 #include "gstnvdsmeta.h"
 #include "gstnvfpfilter.h"
+#include "gstnvdsinfer.h"
+#include "gst-nvevent.h"
 #include <json-glib/json-glib.h>
 #include "ds_usr_prompt_handler.h"
 #include "ds_dynamic_link_unlink_element.h"
 #include "ds_save_frame.h"
+#include "ds_latency_stats.h"
+#include "ds_metrics_server.h"
+#include "ds_latency_tracer.h"
+#include "ds_branch_merge.h"
+#include "ds_object_mask.h"
+#include "ds_fp_cache.h"
+#include "ds_fp_feedback.h"
+#include "ds_fp_stats.h"
+#include "ds_geometric_prefilter.h"
+#include "ds_load_shedder.h"
+#include "ds_mask_pyramid.h"
+#include "ds_async_log.h"
+#include "ds_clip_recorder.h"
+#include "ds_dataset_miner.h"
+#include "ds_batch_controller.h"
 
 /* The muxer output resolution must be set if the input streams will be of
  * different resolution. The muxer will scale all the input frames to this
@@ -54,11 +72,20 @@
 #define FPFILTER_CONFIG_FILE  "config/ds_fpfilter_config.txt"
 #define INFER_PEOPLENET_CONFIG_FILE "config/config_infer_peoplenet.txt"
 #define INFER_PEOPLESEMSEGNET_CONFIG_FILE "config/config_infer_peoplesemsegnet.txt"
+#define INFER_PEOPLESEMSEGNET_CROP_CONFIG_FILE "config/config_infer_peoplesemsegnet_crop.txt"
 #define CONFIG_GROUP_PROPERTY                 "property"
 #define CONFIG_PROPERTY_ENABLE_FP_FILTER      "enable-fp-filter"
 #define CONFIG_PROPERTY_PGIE_UNIQUE_ID  "pgie-unique-id"
+#define CONFIG_PROPERTY_SEG_MIOU_THRESHOLD  "seg-miou-threshold"
+#define CONFIG_PROPERTY_BBOX_ASSESSOR_IDS   "bbox-assessor-unique-id-list"
+#define CONFIG_PROPERTY_ENABLE_SEG_MASK_FILTERING   "enable-seg-mask-filtering"
+#define CONFIG_PROPERTY_ENABLE_TRACKER_FILTERING    "enable-tracker-filtering"
+#define CONFIG_PROPERTY_CLASSES_TO_FILTER   "classes-to-filter"
 
 #define FALSE_POSITIVE_PERCENTAGE_THRESHOLD    0.5
+
+/* Maximum number of input sources */
+#define MAX_NUM_SOURCES   64
 #define CHECK_ERROR(error) \
     if (error) { \
         g_printerr ("Error while parsing config file: %s\n", error->message); \
@@ -82,10 +109,177 @@
 #define USR_PROMPT_KEY_SAVE_FP_ENABLE     "save-fp-enable"
 #define USR_PROMPT_KEY_SAVE_FP_DISABLE    "save-fp-disable"
 #define USR_PROMPT_KEY_DURATION           "duration"
+#define USR_PROMPT_KEY_STATS              "stats"
+#define USR_PROMPT_KEY_STATS_RESET        "stats-reset"
+#define USR_PROMPT_KEY_LATENCY            "latency"
+#define USR_PROMPT_KEY_ADD                "add"
+#define USR_PROMPT_KEY_REMOVE             "remove"
+#define USR_PROMPT_KEY_LOCATION           "location"
+#define USR_PROMPT_KEY_ID                 "id"
+#define USR_PROMPT_KEY_STREAM_ENABLE      "stream-enable"
+#define USR_PROMPT_KEY_STREAM_DISABLE     "stream-disable"
+#define USR_PROMPT_KEY_SOURCES            "sources"
+#define USR_PROMPT_KEY_RECORD_CLIP        "record-clip"
+
+#define FPFILTER_ELEMENT_NAME   "fp-filter"
+#define ASSESSOR_ELEMENT_NAME   "primary-nvinference-engine2"
+
+/* Assessor inference interval while fpfilter is bypassed. nvinfer skips this
+ * many batches between inferences, so the assessor effectively stops running
+ * while its engine stays loaded. */
+#define ASSESSOR_BYPASS_INTERVAL   G_MAXINT
+#define ASSESSOR_ACTIVE_INTERVAL   0
 
 gint frame_number = 0;
 static gchar output_path[1024] = {0,};
-static gchar source_info[1024] = {0,};
+
+/* Per source state, indexed by streammux sink pad index */
+typedef struct {
+  gchar location[1024];     /* Input location, passed to save script */
+  gchar kitti_path[1024];   /* Directory for kitti labels of this source */
+  gint last_frame_num;      /* Last frame number seen after fpfilter */
+  gint64 add_time_us;       /* Time the source was added, 0 once its first frame was filtered */
+  GstElement *source_bin;
+  gboolean active;
+} SourceInfo;
+
+static SourceInfo source_infos[MAX_NUM_SOURCES];
+static guint num_sources = 0;
+/* Streams the pipeline is sized for: streammux and inference batch size and tiler grid.
+ * Sources added at runtime take one of these slots. */
+static guint source_slots = 0;
+static gint max_sources = 0;
+/* Slots not taken or reserved by a source add request */
+static gint free_source_slots = 0;
+static GstElement *app_pipeline = NULL;
+
+#define SINK_TYPE_FILE      "file"
+#define SINK_TYPE_DISPLAY   "display"
+#define SINK_TYPE_FAKE      "fake"
+#define SINK_TYPE_NONE      "none"
+#define SINK_TYPE_CLIPS     "clips"
+
+/* Points where a queue can split the pipeline onto another streaming thread */
+typedef enum {
+  QUEUE_AFTER_PRIMARY,    /* between primary detector and the rest of the pipeline */
+  QUEUE_PRE_FILTER,       /* in front of fp-filter-bin */
+  QUEUE_POST_FILTER,      /* behind fp-filter-bin, kitti and frame saving run after it */
+  QUEUE_PRE_ENCODE,       /* in front of the sink bin */
+  QUEUE_MAX
+} QueuePoint;
+
+static const gchar *queue_point_names[QUEUE_MAX] = {
+  "after-primary", "pre-filter", "post-filter", "pre-encode"
+};
+
+static GstElement *stage_queues[QUEUE_MAX] = {NULL,};
+
+static gboolean metadata_only = FALSE;
+/* fp-filter-bin stays linked and is bypassed while disabled instead of being removed */
+static gboolean warm_bypass = FALSE;
+static gchar *sink_type = SINK_TYPE_FILE;
+/* Output is encoded into clips around false positive events instead of one file */
+static gboolean clip_recording = FALSE;
+static gchar *queue_points = NULL;
+static gint queue_max_buffers = 4;
+static gboolean queue_leaky = FALSE;
+static gboolean bench_mode = FALSE;
+static gchar **extra_assessor_configs = NULL;
+static gboolean parallel_assessors = FALSE;
+static gboolean crop_segmentation = FALSE;
+static gboolean fp_cache_enabled = FALSE;
+static gint fp_cache_cell_px = 16;
+static gint fp_cache_revalidate_frames = 30;
+static gchar *prefilter_config_file = NULL;
+static gboolean fp_feedback_enabled = FALSE;
+static gint fp_feedback_frames = 10;
+static gint fp_stats_interval_s = 0;
+static gint fp_stats_window_s = 10;
+static gboolean mask_prescore = FALSE;
+static gboolean load_shedding = FALSE;
+static gboolean generic_object_pass = FALSE;
+static gchar *log_level_name = NULL;
+static gint clip_pre_s = 5;
+static gint clip_post_s = 5;
+static gdouble clip_fp_ratio = FALSE_POSITIVE_PERCENTAGE_THRESHOLD;
+static gint shed_budget_ms = 0;
+static gboolean adaptive_batching = FALSE;
+static gint batch_timeout_min_ms = 5;
+static gint batch_timeout_max_ms = 100;
+static gchar *mine_input = NULL;
+static gint mine_parallel = 8;
+static gdouble mine_fp_ratio = FALSE_POSITIVE_PERCENTAGE_THRESHOLD;
+
+static GOptionEntry option_entries[] = {
+  { "metadata-only", 'm', 0, G_OPTION_ARG_NONE, &metadata_only,
+    "Skip conversions, OSD and encoding, end the pipeline in a fakesink. No output video is written. Same as --sink=none.", NULL },
+  { "sink", 's', 0, G_OPTION_ARG_STRING, &sink_type,
+    "Output: file (default, needs output video location), clips (event clips, needs output directory), display, fake (full output path into fakesink) or none (metadata only)", "TYPE" },
+  { "warm-bypass", 'w', 0, G_OPTION_ARG_NONE, &warm_bypass,
+    "Keep fp-filter-bin linked and loaded while fpfilter is disabled and bypass it, so enable/disable applies on the next batch", NULL },
+  { "max-sources", 0, 0, G_OPTION_ARG_INT, &max_sources,
+    "Size batches and the tiler for this many sources so that sources can be added at runtime, default the number of inputs", "N" },
+  { "queues", 'q', 0, G_OPTION_ARG_STRING, &queue_points,
+    "Comma separated queue insertion points: after-primary, pre-filter, post-filter, pre-encode or all", "POINTS" },
+  { "queue-size", 0, 0, G_OPTION_ARG_INT, &queue_max_buffers,
+    "Maximum buffers (batches) held by each inserted queue, default 4", "N" },
+  { "queue-leaky", 0, 0, G_OPTION_ARG_NONE, &queue_leaky,
+    "Drop the oldest batch instead of blocking when an inserted queue is full", NULL },
+  { "bench", 'b', 0, G_OPTION_ARG_NONE, &bench_mode,
+    "Print fps and fill level of inserted queues every second", NULL },
+  { "assessor-config", 'a', 0, G_OPTION_ARG_FILENAME_ARRAY, &extra_assessor_configs,
+    "nvinfer config of an additional assessor, can be given more than once", "FILE" },
+  { "parallel-assessors", 'p', 0, G_OPTION_ARG_NONE, &parallel_assessors,
+    "Run assessors in parallel tee branches and merge their metadata before fpfilter", NULL },
+  { "crop-segmentation", 'c', 0, G_OPTION_ARG_NONE, &crop_segmentation,
+    "Run the segmentation assessor on object crops instead of full frames", NULL },
+  { "fp-cache", 0, 0, G_OPTION_ARG_NONE, &fp_cache_enabled,
+    "Reuse false positive verdicts of static boxes instead of assessing them every frame", NULL },
+  { "fp-cache-cell", 0, 0, G_OPTION_ARG_INT, &fp_cache_cell_px,
+    "Box edges within one cell of this many pixels match a cached false positive, default 16", "PIXELS" },
+  { "fp-cache-revalidate", 0, 0, G_OPTION_ARG_INT, &fp_cache_revalidate_frames,
+    "Frames a cached false positive is reused before it is assessed again, default 30", "FRAMES" },
+  { "prefilter-config", 0, 0, G_OPTION_ARG_FILENAME, &prefilter_config_file,
+    "Geometric pre-filter config (e.g. config/ds_prefilter_config.txt) applied to primary boxes in front of the assessors", "FILE" },
+  { "fp-feedback", 0, 0, G_OPTION_ARG_NONE, &fp_feedback_enabled,
+    "Send tracks confirmed as false positive back to the tracker, which drops their detections", NULL },
+  { "fp-feedback-frames", 0, 0, G_OPTION_ARG_INT, &fp_feedback_frames,
+    "Consecutive false positive verdicts confirming a track for --fp-feedback, default 10", "FRAMES" },
+  { "fp-stats-interval", 0, 0, G_OPTION_ARG_INT, &fp_stats_interval_s,
+    "Post windowed per stream fp/tp statistics as fpfilter-stats element messages every this many seconds, 0 (default) disables", "SECONDS" },
+  { "fp-stats-window", 0, 0, G_OPTION_ARG_INT, &fp_stats_window_s,
+    "Window of the fp/tp statistics, default 10, at most 60", "SECONDS" },
+  { "mask-prescore", 0, 0, G_OPTION_ARG_NONE, &mask_prescore,
+    "Remove boxes clearly below seg-miou-threshold from a coarse mask level in front of fpfilter, only boxes near it are scored at full resolution", NULL },
+  { "generic-object-pass", 0, 0, G_OPTION_ARG_NONE, &generic_object_pass,
+    "Use the generic instead of the feature specialized object pass behind fpfilter, to compare them with --bench", NULL },
+  { "log-level", 0, 0, G_OPTION_ARG_STRING, &log_level_name,
+    "Log level of streaming thread logs: error, warning, info (default), debug or frame (adds per frame lines)", "LEVEL" },
+  { "clip-pre", 0, 0, G_OPTION_ARG_INT, &clip_pre_s,
+    "Seconds recorded before a clip trigger with --sink=clips, default 5", "SECONDS" },
+  { "clip-post", 0, 0, G_OPTION_ARG_INT, &clip_post_s,
+    "Seconds recorded after the last clip trigger with --sink=clips, default 5", "SECONDS" },
+  { "clip-fp-ratio", 0, 0, G_OPTION_ARG_DOUBLE, &clip_fp_ratio,
+    "False positive ratio of a frame (with at least 2 objects) triggering a clip, default 0.5", "RATIO" },
+  { "load-shedding", 0, 0, G_OPTION_ARG_NONE, &load_shedding,
+    "Assess fewer batches while the pipeline falls behind, down to fpfilter passthrough, and recover when it catches up", NULL },
+  { "shed-budget-ms", 0, 0, G_OPTION_ARG_INT, &shed_budget_ms,
+    "Per batch time budget from streammux to fpfilter, required by --load-shedding", "MS" },
+  { "adaptive-batching", 0, 0, G_OPTION_ARG_NONE, &adaptive_batching,
+    "Adjust the streammux batched-push-timeout at runtime to the batch fill and the arrival rate of the sources", NULL },
+  { "batch-timeout-min-ms", 0, 0, G_OPTION_ARG_INT, &batch_timeout_min_ms,
+    "Lower bound of the adaptive batched-push-timeout, default 5", "MS" },
+  { "batch-timeout-max-ms", 0, 0, G_OPTION_ARG_INT, &batch_timeout_max_ms,
+    "Upper bound of the adaptive batched-push-timeout, the latency added waiting for a batch, default 100", "MS" },
+  { "mine", 0, 0, G_OPTION_ARG_FILENAME, &mine_input,
+    "Mine a directory of images and videos, or a file listing them, as fast as inference allows. The only argument is the output directory for verdicts, selected frames and the resume checkpoint", "PATH" },
+  { "mine-parallel", 0, 0, G_OPTION_ARG_INT, &mine_parallel,
+    "Items decoded in parallel while mining, also the batch size, default 8", "N" },
+  { "mine-fp-ratio", 0, 0, G_OPTION_ARG_DOUBLE, &mine_fp_ratio,
+    "False positive ratio of a frame selected while mining, default 0.5", "RATIO" },
+  { NULL },
+};
+static GstElement *app_streammux = NULL;
 static gboolean is_fpfilter_enabled = FALSE;
 LinkUnlinkInfo fp_filter_dynamic_link_info = {0,};
 static gboolean save_fpfilter_images = FALSE;
@@ -95,8 +289,501 @@ static gint pgie_unique_id = -1;
 
 static GAsyncQueue *frame_save_queue = NULL;
 
+/* Toggle latency and dropped frames bookkeeping for enable/disable commands */
+static gint64 fpfilter_toggle_time_us = 0;
+static guint dropped_frame_cnt = 0;
+static guint toggle_dropped_frame_cnt = 0;
+static GMutex fpfilter_toggle_mutex;
+
 GstElement *fpfilter_bin = NULL;
 
+/* Per batch processing time of fpfilter and of the application probe */
+typedef enum {
+  STAGE_FPFILTER,           /* nvfpfilter transform, sink pad to src pad */
+  STAGE_KITTI_WRITE,        /* write_kitti_output */
+  STAGE_SAVE_FRAMES,        /* save_frames_for_processing */
+  STAGE_OBJECT_PASS,        /* object pass behind nvfpfilter */
+  STAGE_MAX
+} PipelineStage;
+
+static LatencyStats stage_stats[STAGE_MAX];
+static const gchar *stage_names[STAGE_MAX] = { "fpfilter", "kitti-write", "save-frames", "object-pass" };
+/* Counters for the metrics endpoint. Updated atomically on the streaming
+ * thread and formatted only when metrics are scraped. */
+typedef struct {
+  gint frames;
+  gint fp_count;
+  gint tp_count;
+} StreamMetrics;
+
+static StreamMetrics stream_metrics[MAX_NUM_SOURCES];
+/* Frames of streams whose slot was reused, kept for the aggregate fps */
+static gint retired_frames = 0;
+static gint kitti_frames_written = 0;
+/* Frames batched by streammux, the KITTI writer lag is the difference to processed frames */
+static gint muxed_frames = 0;
+
+/* nvfpfilter transforms in place on its streaming thread, so only one batch is in flight */
+static guint64 fpfilter_transform_start_ns = 0;
+
+/* Per stream fpfilter enable mask. Primary objects of disabled streams are given
+ * FPFILTER_MASKED_COMPONENT_ID while they pass nvfpfilter, so it does not assess
+ * or remove them. The assessors have no per source selection and still infer on
+ * the frames of disabled streams. */
+#define FPFILTER_MASKED_COMPONENT_ID   G_MAXINT
+static gint fpfilter_stream_disabled[MAX_NUM_SOURCES];
+static gint fpfilter_disabled_stream_cnt = 0;
+static gint fpfilter_mask_active = FALSE;
+static GMutex fpfilter_stream_mask_mutex;
+
+/* Load shedding levels, cheapest last. Assessors skip batches through their
+ * interval property, frames without assessor output then pass nvfpfilter
+ * unfiltered instead of being judged without masks. */
+typedef enum {
+  SHED_LEVEL_FULL,
+  SHED_LEVEL_HALF_ASSESSMENT,
+  SHED_LEVEL_QUARTER_ASSESSMENT,
+  SHED_LEVEL_PASSTHROUGH,
+  SHED_LEVEL_MAX
+} ShedLevel;
+
+static const gchar *shed_level_names[SHED_LEVEL_MAX] = {
+  "full", "half-assessment", "quarter-assessment", "passthrough"
+};
+static const gint shed_assessor_intervals[SHED_LEVEL_MAX] = { 0, 1, 3, G_MAXINT };
+
+/* Hides primary objects of frames the assessors skipped */
+static void
+mask_unassessed_frame_objects (GstBuffer *buf)
+{
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  if (!batch_meta)
+    return;
+
+  for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = l_frame->data;
+    gboolean assessed = FALSE;
+    for (NvDsMetaList * l_user = frame_meta->frame_user_meta_list; l_user != NULL; l_user = l_user->next) {
+      NvDsUserMeta *user_meta = (NvDsUserMeta *) l_user->data;
+      if (user_meta->base_meta.meta_type == NVDSINFER_SEGMENTATION_META)
+        assessed = TRUE;
+    }
+    if (assessed)
+      continue;
+
+    g_atomic_int_set (&fpfilter_mask_active, TRUE);
+    for (NvDsMetaList * l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
+      NvDsObjectMeta *obj = (NvDsObjectMeta *) l_obj->data;
+      if (obj->unique_component_id == pgie_unique_id)
+        obj->unique_component_id = FPFILTER_MASKED_COMPONENT_ID;
+    }
+  }
+}
+
+/* Static false positive cache. Primary objects matching a cached verdict are given
+ * FPFILTER_CACHED_COMPONENT_ID in front of the assessors, so neither assessors
+ * operating on the pgie nor nvfpfilter spend time on them, and are removed behind
+ * nvfpfilter like the false positives it removes itself. */
+#define FPFILTER_CACHED_COMPONENT_ID   (G_MAXINT - 1)
+
+typedef struct {
+  NvDsObjectMeta *obj;
+  guint64 object_id;
+  gint class_id;
+  gfloat confidence;
+  guint stream;
+  gint frame_num;
+  NvOSD_RectParams rect;
+} AssessedObject;
+
+/* Primary objects entering nvfpfilter, only one batch is in flight */
+static GArray *fpfilter_assessed_objects = NULL;
+static gint fp_cache_hits = 0;
+
+/* Primary objects passed by the geometric pre-filter keep this id while they pass
+ * the assessors and nvfpfilter, and get the pgie id back behind it */
+#define FPFILTER_PREFILTER_PASS_COMPONENT_ID   (G_MAXINT - 2)
+
+/* Primary objects whose mask coverage is clearly below seg-miou-threshold get this id
+ * in front of nvfpfilter and are removed behind it. The mIoU of a box and a mask never
+ * exceeds the masked fraction of the box, so these boxes would fail the check anyway. */
+#define FPFILTER_PRESCORED_FP_COMPONENT_ID   (G_MAXINT - 3)
+
+static gdouble seg_miou_threshold = 0;
+/* classes-to-filter of nvfpfilter, boxes of other classes are never scored */
+static gchar **prescore_classes = NULL;
+static MaskPyramid prescore_pyramid;
+static gint prescore_boxes = 0;
+static gint prescore_rejected = 0;
+static gint prescore_refined = 0;
+
+static gboolean
+is_prescore_class (NvDsObjectMeta *obj)
+{
+  for (gchar **label = prescore_classes; *label; label++)
+    if (!g_ascii_strcasecmp (*label, obj->obj_label))
+      return TRUE;
+  return FALSE;
+}
+
+/* Scores primary boxes of frames with a segmentation mask coarse to fine */
+static void
+prescore_seg_masks (GstBuffer *buf)
+{
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  if (!batch_meta)
+    return;
+
+  for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = l_frame->data;
+    NvDsInferSegmentationMeta *seg_meta = NULL;
+    for (NvDsMetaList * l_user = frame_meta->frame_user_meta_list; l_user != NULL; l_user = l_user->next) {
+      NvDsUserMeta *user_meta = (NvDsUserMeta *) l_user->data;
+      if (user_meta->base_meta.meta_type == NVDSINFER_SEGMENTATION_META)
+        seg_meta = (NvDsInferSegmentationMeta *) user_meta->user_meta_data;
+    }
+    if (!seg_meta || !seg_meta->class_map)
+      continue;
+
+    gboolean built = FALSE;
+    gdouble scale_x = (gdouble) seg_meta->width / MUXER_OUTPUT_WIDTH;
+    gdouble scale_y = (gdouble) seg_meta->height / MUXER_OUTPUT_HEIGHT;
+    for (NvDsMetaList * l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
+      NvDsObjectMeta *obj = (NvDsObjectMeta *) l_obj->data;
+      if ((obj->unique_component_id != pgie_unique_id) || !is_prescore_class (obj))
+        continue;
+      /* Pyramid is built only for frames with boxes to score */
+      if (!built) {
+        mask_pyramid_build (&prescore_pyramid, seg_meta->class_map, seg_meta->width, seg_meta->height);
+        built = TRUE;
+      }
+
+      NvOSD_RectParams *rect = &obj->rect_params;
+      gboolean refined = FALSE;
+      gdouble coverage = mask_pyramid_coverage (&prescore_pyramid,
+          (gint) (rect->left * scale_x), (gint) (rect->top * scale_y),
+          (gint) ceil ((rect->left + rect->width) * scale_x), (gint) ceil ((rect->top + rect->height) * scale_y),
+          seg_miou_threshold, &refined);
+      g_atomic_int_inc (&prescore_boxes);
+      if (refined)
+        g_atomic_int_inc (&prescore_refined);
+      if (coverage < seg_miou_threshold) {
+        obj->unique_component_id = FPFILTER_PRESCORED_FP_COMPONENT_ID;
+        g_atomic_int_inc (&prescore_rejected);
+      }
+    }
+  }
+}
+
+/* Rejects or passes primary objects on geometry alone, in front of the assessors */
+static GstPadProbeReturn
+prefilter_probe (GstPad * pad, GstPadProbeInfo * info, gpointer u_data)
+{
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (GST_PAD_PROBE_INFO_BUFFER (info));
+  if (!batch_meta || !is_fpfilter_enabled)
+    return GST_PAD_PROBE_OK;
+
+  for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = l_frame->data;
+    if ((frame_meta->pad_index < MAX_NUM_SOURCES) &&
+        g_atomic_int_get (&fpfilter_stream_disabled[frame_meta->pad_index]))
+      continue;
+    prefilter_process_frame (frame_meta, pgie_unique_id, FPFILTER_PREFILTER_PASS_COMPONENT_ID);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+/* Hides primary objects matching a cached static false positive from the assessors */
+static GstPadProbeReturn
+fp_cache_lookup_probe (GstPad * pad, GstPadProbeInfo * info, gpointer u_data)
+{
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (GST_PAD_PROBE_INFO_BUFFER (info));
+  /* Verdicts are applied only where nvfpfilter would assess the objects itself */
+  if (!batch_meta || !is_fpfilter_enabled)
+    return GST_PAD_PROBE_OK;
+
+  for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = l_frame->data;
+    if ((frame_meta->pad_index < MAX_NUM_SOURCES) &&
+        g_atomic_int_get (&fpfilter_stream_disabled[frame_meta->pad_index]))
+      continue;
+    for (NvDsMetaList * l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
+      NvDsObjectMeta *obj = (NvDsObjectMeta *) l_obj->data;
+      if ((obj->unique_component_id == pgie_unique_id) &&
+          fp_cache_lookup (frame_meta->pad_index, frame_meta->frame_num, &obj->rect_params))
+        obj->unique_component_id = FPFILTER_CACHED_COMPONENT_ID;
+    }
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+/* Remembers primary objects nvfpfilter is about to assess */
+static void
+snapshot_assessed_objects (GstBuffer *buf)
+{
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  g_array_set_size (fpfilter_assessed_objects, 0);
+  if (!batch_meta)
+    return;
+
+  for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = l_frame->data;
+    for (NvDsMetaList * l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
+      NvDsObjectMeta *obj = (NvDsObjectMeta *) l_obj->data;
+      if (obj->unique_component_id != pgie_unique_id)
+        continue;
+      AssessedObject assessed = { obj, obj->object_id, obj->class_id, obj->confidence, frame_meta->pad_index, frame_meta->frame_num, obj->rect_params };
+      g_array_append_val (fpfilter_assessed_objects, assessed);
+    }
+  }
+}
+
+/* Learns verdicts from the objects nvfpfilter removed or kept, and feeds them to the
+ * cache, the tracker feedback and the statistics. sink_pad is the nvfpfilter sink pad
+ * feedback is sent through. */
+static void
+apply_assessed_verdicts (GHashTable *kept, GstPad *sink_pad)
+{
+  for (guint idx = 0; idx < fpfilter_assessed_objects->len; idx++)
+  {
+    AssessedObject *assessed = &g_array_index (fpfilter_assessed_objects, AssessedObject, idx);
+    gboolean is_fp = !g_hash_table_contains (kept, assessed->obj);
+    if (fp_cache_enabled && is_fp)
+      fp_cache_add_fp (assessed->stream, assessed->frame_num, &assessed->rect);
+    else if (fp_cache_enabled)
+      fp_cache_remove (assessed->stream, &assessed->rect);
+    if (fp_feedback_enabled)
+      fp_feedback_record_verdict (sink_pad, assessed->stream, assessed->frame_num,
+          assessed->object_id, assessed->class_id, &assessed->rect, is_fp);
+    if (fp_stats_interval_s > 0)
+      fp_stats_add_object (assessed->stream, assessed->class_id, assessed->confidence, is_fp);
+  }
+  g_array_set_size (fpfilter_assessed_objects, 0);
+}
+
+/* Replaces component id from_id with to_id, only in frames of disabled streams if disabled_only is set */
+static void
+swap_component_ids (GstBuffer *buf, gint from_id, gint to_id, gboolean disabled_only)
+{
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  if (!batch_meta)
+    return;
+
+  for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = l_frame->data;
+    if (disabled_only && ((frame_meta->pad_index >= MAX_NUM_SOURCES) ||
+        !g_atomic_int_get (&fpfilter_stream_disabled[frame_meta->pad_index])))
+      continue;
+
+    for (NvDsMetaList * l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
+      NvDsObjectMeta *obj = (NvDsObjectMeta *) l_obj->data;
+      if (obj->unique_component_id == from_id)
+        obj->unique_component_id = to_id;
+    }
+  }
+}
+
+static GstPadProbeReturn
+fpfilter_sink_probe (GstPad * pad, GstPadProbeInfo * info, gpointer u_data)
+{
+  /* Hide primary objects of disabled streams, nvfpfilter only assesses pgie objects */
+  if (g_atomic_int_get (&fpfilter_disabled_stream_cnt))
+    swap_component_ids (GST_PAD_PROBE_INFO_BUFFER (info), pgie_unique_id, FPFILTER_MASKED_COMPONENT_ID, TRUE);
+  guint shed_level = load_shedding ? load_shedder_get_level () : SHED_LEVEL_FULL;
+  if ((shed_level == SHED_LEVEL_HALF_ASSESSMENT) || (shed_level == SHED_LEVEL_QUARTER_ASSESSMENT))
+    mask_unassessed_frame_objects (GST_PAD_PROBE_INFO_BUFFER (info));
+  if (mask_prescore && is_fpfilter_enabled)
+    prescore_seg_masks (GST_PAD_PROBE_INFO_BUFFER (info));
+  if (fp_cache_enabled || fp_feedback_enabled || (fp_stats_interval_s > 0))
+    snapshot_assessed_objects (GST_PAD_PROBE_INFO_BUFFER (info));
+
+  fpfilter_transform_start_ns = g_get_monotonic_time () * 1000;
+  return GST_PAD_PROBE_OK;
+}
+
+/* Objects removed on nvfpfilter's behalf are false positives of the frame, count them
+ * in its fpfilter meta so ratios, statistics and frame saving see them */
+static void
+add_frame_fp_count (NvDsFrameMeta *frame_meta, guint count)
+{
+  for (NvDsMetaList * l_user = frame_meta->frame_user_meta_list; l_user != NULL; l_user = l_user->next) {
+    NvDsUserMeta *user_meta = (NvDsUserMeta *) l_user->data;
+    if (user_meta->base_meta.meta_type == NVFPFILTER_USER_META) {
+      ((NvFpFilterMeta *) user_meta->user_meta_data)->fp_count += count;
+      return;
+    }
+  }
+}
+
+/* Work of the object pass behind nvfpfilter */
+typedef enum {
+  OBJECT_PASS_VERDICTS  = 1 << 0,   /* collect objects nvfpfilter kept */
+  OBJECT_PASS_CACHE     = 1 << 1,   /* remove objects hidden by the fp cache */
+  OBJECT_PASS_PRESCORE  = 1 << 2,   /* remove objects rejected by the mask prescore */
+  OBJECT_PASS_PREFILTER = 1 << 3,   /* restore objects passed by the pre-filter */
+  OBJECT_PASS_MASK      = 1 << 4,   /* restore objects of disabled streams */
+  OBJECT_PASS_ALL       = (1 << 5) - 1
+} ObjectPassFeature;
+
+/* Features enabled by the command line, chosen once at startup */
+static guint object_pass_features = 0;
+
+/* All object handling behind nvfpfilter in one walk over the batch. Inlined with a
+ * constant features value, the feature checks drop out of the per object loop. */
+static inline __attribute__ ((always_inline)) void
+object_pass_impl (NvDsBatchMeta *batch_meta, GHashTable *kept, const guint features)
+{
+  for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = l_frame->data;
+    GList *removed = NULL;
+    guint cached = 0;
+    guint prescored = 0;
+    for (NvDsMetaList * l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
+      NvDsObjectMeta *obj = (NvDsObjectMeta *) l_obj->data;
+      gint id = obj->unique_component_id;
+      if ((features & OBJECT_PASS_CACHE) && (id == FPFILTER_CACHED_COMPONENT_ID)) {
+        removed = g_list_prepend (removed, obj);
+        cached++;
+        continue;
+      }
+      if ((features & OBJECT_PASS_PRESCORE) && (id == FPFILTER_PRESCORED_FP_COMPONENT_ID)) {
+        removed = g_list_prepend (removed, obj);
+        prescored++;
+        continue;
+      }
+      if ((features & OBJECT_PASS_PREFILTER) && (id == FPFILTER_PREFILTER_PASS_COMPONENT_ID))
+        obj->unique_component_id = pgie_unique_id;
+      else if ((features & OBJECT_PASS_MASK) && (id == FPFILTER_MASKED_COMPONENT_ID))
+        obj->unique_component_id = pgie_unique_id;
+      if (features & OBJECT_PASS_VERDICTS)
+        g_hash_table_add (kept, obj);
+    }
+    if (!removed)
+      continue;
+    for (GList *l = removed; l != NULL; l = l->next)
+      nvds_remove_obj_meta_from_frame (frame_meta, (NvDsObjectMeta *) l->data);
+    if (cached + prescored)
+      add_frame_fp_count (frame_meta, cached + prescored);
+    g_atomic_int_add (&fp_cache_hits, cached);
+    g_list_free (removed);
+  }
+}
+
+/* Reference path checking features per object, for --generic-object-pass */
+static __attribute__ ((noinline)) void
+object_pass_generic (NvDsBatchMeta *batch_meta, GHashTable *kept, guint features)
+{
+  object_pass_impl (batch_meta, kept, features);
+}
+
+#define OBJECT_PASS_CASE(f)   case (f): object_pass_impl (batch_meta, kept, (f)); break;
+#define OBJECT_PASS_CASES4(f) OBJECT_PASS_CASE (f) OBJECT_PASS_CASE ((f) + 1) \
+    OBJECT_PASS_CASE ((f) + 2) OBJECT_PASS_CASE ((f) + 3)
+#define OBJECT_PASS_CASES16(f) OBJECT_PASS_CASES4 (f) OBJECT_PASS_CASES4 ((f) + 4) \
+    OBJECT_PASS_CASES4 ((f) + 8) OBJECT_PASS_CASES4 ((f) + 12)
+
+/* Dispatches to the instantiation for the feature combination */
+static void
+object_pass_specialized (NvDsBatchMeta *batch_meta, GHashTable *kept, guint features)
+{
+  switch (features & OBJECT_PASS_ALL) {
+    OBJECT_PASS_CASES16 (0)
+    OBJECT_PASS_CASES16 (16)
+  }
+}
+
+static void
+init_object_pass_features (void)
+{
+  if (fp_cache_enabled || fp_feedback_enabled || (fp_stats_interval_s > 0))
+    object_pass_features |= OBJECT_PASS_VERDICTS;
+  if (fp_cache_enabled)
+    object_pass_features |= OBJECT_PASS_CACHE;
+  if (mask_prescore)
+    object_pass_features |= OBJECT_PASS_PRESCORE;
+  if (prefilter_config_file)
+    object_pass_features |= OBJECT_PASS_PREFILTER;
+}
+
+static GstPadProbeReturn
+fpfilter_src_probe (GstPad * pad, GstPadProbeInfo * info, gpointer u_data)
+{
+  if (fpfilter_transform_start_ns)
+    latency_stats_record (&stage_stats[STAGE_FPFILTER],
+        g_get_monotonic_time () * 1000 - fpfilter_transform_start_ns);
+
+  /* Objects are masked only while passing nvfpfilter. Restore in all frames once any
+   * stream was disabled, a stream may have been enabled while the batch was inside. */
+  guint features = object_pass_features;
+  if (g_atomic_int_get (&fpfilter_mask_active))
+    features |= OBJECT_PASS_MASK;
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (GST_PAD_PROBE_INFO_BUFFER (info));
+  if (!features || !batch_meta)
+    return GST_PAD_PROBE_OK;
+
+  gint64 start_ns = g_get_monotonic_time () * 1000;
+  GHashTable *kept = (features & OBJECT_PASS_VERDICTS) ? g_hash_table_new (g_direct_hash, g_direct_equal) : NULL;
+  if (generic_object_pass)
+    object_pass_generic (batch_meta, kept, features);
+  else
+    object_pass_specialized (batch_meta, kept, features);
+  if (kept) {
+    apply_assessed_verdicts (kept, (GstPad *) u_data);
+    g_hash_table_destroy (kept);
+  }
+  latency_stats_record (&stage_stats[STAGE_OBJECT_PASS], g_get_monotonic_time () * 1000 - start_ns);
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+set_fpfilter_stream_enabled (guint index, gboolean enable)
+{
+  if (index >= MAX_NUM_SOURCES)
+    return;
+
+  g_mutex_lock(&fpfilter_stream_mask_mutex);
+  gboolean disabled = g_atomic_int_get (&fpfilter_stream_disabled[index]);
+  if (disabled == !enable)
+  {
+    g_mutex_unlock(&fpfilter_stream_mask_mutex);
+    return;
+  }
+
+  if (!enable)
+  {
+    g_atomic_int_set (&fpfilter_mask_active, TRUE);
+    g_atomic_int_inc (&fpfilter_disabled_stream_cnt);
+  }
+  else
+  {
+    g_atomic_int_add (&fpfilter_disabled_stream_cnt, -1);
+  }
+  g_atomic_int_set (&fpfilter_stream_disabled[index], !enable);
+  g_mutex_unlock(&fpfilter_stream_mask_mutex);
+  g_print("fpfilter %s for source %u\n", enable ? "enabled" : "disabled", index);
+}
+
+static void
+init_stage_stats(void)
+{
+  for (guint idx = 0; idx < STAGE_MAX; idx++)
+    latency_stats_init (&stage_stats[idx], stage_names[idx]);
+}
+
+static void
+print_stage_stats(void)
+{
+  for (guint idx = 0; idx < STAGE_MAX; idx++)
+    latency_stats_print (&stage_stats[idx]);
+}
+
+static void
+reset_stage_stats(void)
+{
+  for (guint idx = 0; idx < STAGE_MAX; idx++)
+    latency_stats_reset (&stage_stats[idx]);
+}
+
 /* Taken from ds test2 app */
 /* Tracker config parsing */
 static gchar *
@@ -213,18 +900,179 @@ done:
   return ret;
 }
 
+/* fpfilter checks masks at frame level, so per object masks of the crop
+ * segmentation assessor are composed into a frame map in front of it */
+static GstPadProbeReturn
+compose_object_masks_probe (GstPad * pad, GstPadProbeInfo * info, gpointer u_data)
+{
+  GstBuffer *buf = (GstBuffer *) info->data;
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  if (batch_meta)
+    object_mask_compose_frame_masks (batch_meta, MUXER_OUTPUT_WIDTH, MUXER_OUTPUT_HEIGHT,
+        MUXER_OUTPUT_WIDTH, MUXER_OUTPUT_HEIGHT);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Name of the assessor nvinfer element, the default assessor keeps its historical name */
+static gchar *
+get_assessor_name (guint idx)
+{
+  return idx ? g_strdup_printf ("%s-%u", ASSESSOR_ELEMENT_NAME, idx) : g_strdup (ASSESSOR_ELEMENT_NAME);
+}
+
+static guint
+get_num_assessors (void)
+{
+  return 1 + (extra_assessor_configs ? g_strv_length (extra_assessor_configs) : 0);
+}
+
+static GstElement *
+create_assessor (guint idx)
+{
+  gchar *name = get_assessor_name (idx);
+  GstElement *assessor = gst_element_factory_make ("nvinfer", name);
+  g_free (name);
+  if (!assessor)
+    return NULL;
+
+  if (idx)
+  {
+    g_object_set (G_OBJECT (assessor), "config-file-path", extra_assessor_configs[idx - 1], NULL);
+    g_object_set (G_OBJECT (assessor), "batch-size", source_slots, NULL);
+  }
+  else if (crop_segmentation)
+  {
+    /* Batches objects, batch size comes from the config */
+    g_object_set (G_OBJECT (assessor), "config-file-path", INFER_PEOPLESEMSEGNET_CROP_CONFIG_FILE, NULL);
+  }
+  else
+  {
+    g_object_set (G_OBJECT (assessor), "config-file-path", INFER_PEOPLESEMSEGNET_CONFIG_FILE, NULL);
+    g_object_set (G_OBJECT (assessor), "batch-size", source_slots, NULL);
+  }
+  return assessor;
+}
+
+/* Runs every assessor in its own tee branch: tee -> queue -> assessor -> fakesink.
+ * The main branch tee -> queue waits on its src pad until all assessors are done
+ * with the batch, so the batch reaching fpfilter carries the metadata of all of
+ * them and latency follows the slowest assessor instead of their sum. */
+static gboolean
+add_parallel_assessors (GstElement *bin, GstElement *nvtracker, GstElement *fpfilter)
+{
+  guint num_assessors = get_num_assessors ();
+  GstElement *tee = gst_element_factory_make ("tee", "assessor-tee");
+  GstElement *main_queue = gst_element_factory_make ("queue", "assessor-merge-queue");
+  if (!tee || !main_queue)
+    return FALSE;
+
+  gst_bin_add_many (GST_BIN (bin), tee, main_queue, NULL);
+  if (!gst_element_link_many (nvtracker, tee, main_queue, fpfilter, NULL))
+    return FALSE;
+
+  BranchMerge *merge = branch_merge_new ("assessor-merge", num_assessors);
+  /* Probes use the merge until the bin and its children are finalized */
+  g_object_set_data_full (G_OBJECT (bin), "assessor-merge", merge, (GDestroyNotify) branch_merge_free);
+  if (!branch_merge_set_output (merge, main_queue))
+    return FALSE;
+
+  for (guint idx = 0; idx < num_assessors; idx++)
+  {
+    gchar *queue_name = g_strdup_printf ("assessor-queue-%u", idx);
+    gchar *sink_name = g_strdup_printf ("assessor-sink-%u", idx);
+    GstElement *queue = gst_element_factory_make ("queue", queue_name);
+    GstElement *assessor = create_assessor (idx);
+    GstElement *fakesink = gst_element_factory_make ("fakesink", sink_name);
+    g_free (queue_name);
+    g_free (sink_name);
+    if (!queue || !assessor || !fakesink)
+      return FALSE;
+
+    g_object_set (G_OBJECT (fakesink), "sync", FALSE, "async", FALSE, NULL);
+    gst_bin_add_many (GST_BIN (bin), queue, assessor, fakesink, NULL);
+    if (!gst_element_link_many (tee, queue, assessor, fakesink, NULL))
+      return FALSE;
+    if (!branch_merge_add_branch (merge, idx, assessor))
+      return FALSE;
+
+    gchar *trace_name = idx ? g_strdup_printf ("assessor%u", idx) : g_strdup ("assessor");
+    latency_tracer_add_element (assessor, trace_name);
+    g_free (trace_name);
+  }
+  return TRUE;
+}
+
+static gboolean
+add_serial_assessors (GstElement *bin, GstElement *nvtracker, GstElement *fpfilter)
+{
+  GstElement *prev = nvtracker;
+  for (guint idx = 0; idx < get_num_assessors (); idx++)
+  {
+    GstElement *assessor = create_assessor (idx);
+    if (!assessor)
+      return FALSE;
+    gst_bin_add (GST_BIN (bin), assessor);
+    if (!gst_element_link (prev, assessor))
+      return FALSE;
+
+    gchar *trace_name = idx ? g_strdup_printf ("assessor%u", idx) : g_strdup ("assessor");
+    latency_tracer_add_element (assessor, trace_name);
+    g_free (trace_name);
+    prev = assessor;
+  }
+  return gst_element_link (prev, fpfilter);
+}
+
+static void
+set_assessors_interval (GstElement *bin, gint interval)
+{
+  for (guint idx = 0; idx < get_num_assessors (); idx++)
+  {
+    gchar *name = get_assessor_name (idx);
+    GstElement *assessor = gst_bin_get_by_name (GST_BIN (bin), name);
+    g_free (name);
+    if (!assessor)
+    {
+      g_printerr("fp filter bin elements not found\n");
+      continue;
+    }
+    g_object_set (G_OBJECT (assessor), "interval", interval, NULL);
+    gst_object_unref (assessor);
+  }
+}
+
+/* Called by the load shedder on the streaming thread */
+static void
+apply_shed_level (guint level)
+{
+  GstElement *bin = fpfilter_bin;
+  if (!is_fpfilter_enabled || !bin)
+    return;
+
+  GstElement *fpfilter = gst_bin_get_by_name (GST_BIN (bin), FPFILTER_ELEMENT_NAME);
+  if (!fpfilter)
+    return;
+
+  set_assessors_interval (bin, shed_assessor_intervals[level]);
+  g_object_set (G_OBJECT (fpfilter), "enable-fp-filter", level != SHED_LEVEL_PASSTHROUGH, NULL);
+
+  gst_element_post_message (fpfilter, gst_message_new_application (GST_OBJECT (fpfilter),
+      gst_structure_new ("fpfilter-degradation", "level", G_TYPE_UINT, level,
+          "mode", G_TYPE_STRING, shed_level_names[level], NULL)));
+  gst_object_unref (fpfilter);
+}
+
 static GstElement *create_filter_elements_bin(gchar *bin_name)
 {
-  GstElement *bin = NULL, *nvtracker = NULL, *secondary_detector = NULL, *fpfilter = NULL;
+  GstElement *bin = NULL, *nvtracker = NULL, *fpfilter = NULL;
   /* Create a source GstBin to abstract this bin's content from the rest of the pipeline */
   bin = gst_bin_new (bin_name);
 
   /* We need to have a tracker to track the identified objects */
   nvtracker = gst_element_factory_make ("nvtracker", "tracker");
-  secondary_detector = gst_element_factory_make ("nvinfer", "primary-nvinference-engine2");
-  fpfilter = gst_element_factory_make ("nvfpfilter", "fp-filter");
+  fpfilter = gst_element_factory_make ("nvfpfilter", FPFILTER_ELEMENT_NAME);
 
-  if (!nvtracker || !secondary_detector || !fpfilter)
+  if (!nvtracker || !fpfilter)
   {
     g_printerr ("One element could not be created. Exiting.\n");
     return NULL;
@@ -236,12 +1084,54 @@ static GstElement *create_filter_elements_bin(gchar *bin_name)
     return NULL;
   }
 
-  g_object_set (G_OBJECT (secondary_detector), "config-file-path", INFER_PEOPLESEMSEGNET_CONFIG_FILE, NULL);
   g_object_set (G_OBJECT (fpfilter), "config-file-path", FPFILTER_CONFIG_FILE, NULL);
   g_object_set (G_OBJECT (fpfilter), "enable-fp-filter", TRUE, NULL);
 
-  gst_bin_add_many (GST_BIN (bin), nvtracker, secondary_detector, fpfilter, NULL);
-  gst_element_link_many (nvtracker, secondary_detector, fpfilter, NULL);
+  gst_bin_add_many (GST_BIN (bin), nvtracker, fpfilter, NULL);
+  /* Parallel branches only pay off with more than one assessor */
+  if ((parallel_assessors && (get_num_assessors () > 1)) ?
+      !add_parallel_assessors (bin, nvtracker, fpfilter) :
+      !add_serial_assessors (bin, nvtracker, fpfilter))
+  {
+    g_printerr ("Failed to create assessors. Exiting.\n");
+    return NULL;
+  }
+
+  latency_tracer_add_element (nvtracker, "tracker");
+  latency_tracer_add_element (fpfilter, "fpfilter");
+  if (load_shedding)
+    load_shedder_watch (fpfilter);
+
+  /* Pre-filter first, so the cache only sees boxes which are left for the assessors */
+  if (prefilter_config_file || fp_cache_enabled)
+  {
+    GstPad *tracker_src_pad = gst_element_get_static_pad (nvtracker, "src");
+    if (!tracker_src_pad)
+    {
+      g_print ("Unable to get tracker src pad\n");
+      return NULL;
+    }
+    if (prefilter_config_file)
+      gst_pad_add_probe (tracker_src_pad, GST_PAD_PROBE_TYPE_BUFFER, prefilter_probe, NULL, NULL);
+    if (fp_cache_enabled)
+      gst_pad_add_probe (tracker_src_pad, GST_PAD_PROBE_TYPE_BUFFER, fp_cache_lookup_probe, NULL, NULL);
+    gst_object_unref (tracker_src_pad);
+  }
+  if (fp_feedback_enabled && !fp_feedback_attach_receiver (nvtracker, pgie_unique_id))
+    return NULL;
+
+  GstPad *filter_sink_pad = gst_element_get_static_pad (fpfilter, "sink");
+  if (!filter_sink_pad)
+  {
+    g_print ("Unable to get sink pad\n");
+    return NULL;
+  }
+  if (crop_segmentation)
+    gst_pad_add_probe (filter_sink_pad, GST_PAD_PROBE_TYPE_BUFFER, compose_object_masks_probe, NULL, NULL);
+  gst_pad_add_probe (filter_sink_pad, GST_PAD_PROBE_TYPE_BUFFER, fpfilter_sink_probe, NULL, NULL);
+  /* The pad stays owned by nvfpfilter, the src probe sends feedback through it */
+  GstPad *feedback_pad = filter_sink_pad;
+  gst_object_unref(filter_sink_pad);
 
   GstPad *filter_src_pad = gst_element_get_static_pad (fpfilter, "src");
   if (!filter_src_pad)
@@ -249,6 +1139,7 @@ static GstElement *create_filter_elements_bin(gchar *bin_name)
     g_print ("Unable to get src pad\n");
     return NULL;
   }
+  gst_pad_add_probe (filter_src_pad, GST_PAD_PROBE_TYPE_BUFFER, fpfilter_src_probe, feedback_pad, NULL);
 
   if (!gst_element_add_pad (bin, gst_ghost_pad_new ("src", filter_src_pad))) {
     g_printerr ("Failed to add ghost pad in fpfilter bin\n");
@@ -321,6 +1212,34 @@ enable_fpfilter_images_save_duration(guint duration_ms)
   return FALSE;
 }
 
+static void
+start_fpfilter_toggle_measurement(void)
+{
+  g_mutex_lock(&fpfilter_toggle_mutex);
+  toggle_dropped_frame_cnt = dropped_frame_cnt;
+  fpfilter_toggle_time_us = g_get_monotonic_time ();
+  g_mutex_unlock(&fpfilter_toggle_mutex);
+}
+
+/* fp-filter-bin stays linked and its engines loaded. Bypass puts nvfpfilter in
+ * passthrough and makes the assessor skip inference, so a toggle takes effect
+ * on the next batch instead of re-creating and re-linking the bin. */
+static void
+set_fpfilter_bypass(gboolean bypass)
+{
+  GstElement *fpfilter = gst_bin_get_by_name (GST_BIN (fpfilter_bin), FPFILTER_ELEMENT_NAME);
+
+  if (!fpfilter)
+  {
+    g_printerr("fp filter bin elements not found\n");
+    return;
+  }
+
+  set_assessors_interval (fpfilter_bin, bypass ? ASSESSOR_BYPASS_INTERVAL : ASSESSOR_ACTIVE_INTERVAL);
+  g_object_set (G_OBJECT (fpfilter), "enable-fp-filter", !bypass, NULL);
+  gst_object_unref (fpfilter);
+}
+
 static void
 enable_fpfilter(void)
 {
@@ -330,20 +1249,60 @@ enable_fpfilter(void)
     return;
   }
 
-  fpfilter_bin = create_filter_elements_bin("fp-filter-bin");
-  if (!fpfilter_bin)
+  start_fpfilter_toggle_measurement();
+  /* Enabled bin starts with full assessment */
+  load_shedder_reset();
+  if (warm_bypass)
   {
-    g_printerr("fp filter bin creation failed\n");
-    return;
+    disable_fpfilter_images_save();
+    set_fpfilter_bypass(FALSE);
   }
+  else
+  {
+    fpfilter_bin = create_filter_elements_bin("fp-filter-bin");
+    if (!fpfilter_bin)
+    {
+      g_printerr("fp filter bin creation failed\n");
+      return;
+    }
 
-  fp_filter_dynamic_link_info.main_element = fpfilter_bin;
-  disable_fpfilter_images_save();
-  add_element_to_pipeline (&fp_filter_dynamic_link_info);
+    fp_filter_dynamic_link_info.main_element = fpfilter_bin;
+    disable_fpfilter_images_save();
+    if (!add_element_to_pipeline (&fp_filter_dynamic_link_info))
+    {
+      g_printerr("fp filter bin could not be added\n");
+      fpfilter_bin = NULL;
+      fp_filter_dynamic_link_info.main_element = NULL;
+      return;
+    }
+  }
   is_fpfilter_enabled = TRUE;
   g_print("fpfilter enabled\n");
 }
 
+/* Relinking failed and the previous links are back, follow the pipeline's actual state */
+static void
+fpfilter_toggle_failed(GstElement *element, gboolean added)
+{
+  if (added)
+  {
+    if (fpfilter_bin == element)
+    {
+      fpfilter_bin = NULL;
+      fp_filter_dynamic_link_info.main_element = NULL;
+    }
+    is_fpfilter_enabled = FALSE;
+    g_printerr("fpfilter enable failed, still disabled\n");
+  }
+  else
+  {
+    fpfilter_bin = element;
+    fp_filter_dynamic_link_info.main_element = element;
+    is_fpfilter_enabled = TRUE;
+    g_printerr("fpfilter disable failed, still enabled\n");
+  }
+}
+
 static void
 disable_fpfilter(void)
 {
@@ -353,32 +1312,75 @@ disable_fpfilter(void)
     return;
   }
 
+  start_fpfilter_toggle_measurement();
   is_fpfilter_enabled = FALSE;
   disable_fpfilter_images_save();
-  remove_element_from_pipeline (&fp_filter_dynamic_link_info);
-  fpfilter_bin = NULL;
-  fp_filter_dynamic_link_info.main_element = NULL;
+  if (warm_bypass)
+  {
+    set_fpfilter_bypass(TRUE);
+  }
+  else
+  {
+    remove_element_from_pipeline (&fp_filter_dynamic_link_info);
+    fpfilter_bin = NULL;
+    fp_filter_dynamic_link_info.main_element = NULL;
+  }
   g_print("fpfilter disabled\n");
 }
 
+/* Counts frames lost between consecutive batches and reports how long the last
+ * enable/disable command took to reach the first batch after it. */
+static void
+update_fpfilter_toggle_stats (NvDsBatchMeta *batch_meta)
+{
+  g_mutex_lock(&fpfilter_toggle_mutex);
+  for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = l_frame->data;
+    if (frame_meta->pad_index >= MAX_NUM_SOURCES)
+      continue;
+    SourceInfo *source = &source_infos[frame_meta->pad_index];
+    if (source->add_time_us)
+    {
+      g_print("source %u: time to first filtered frame: %.3f ms\n", frame_meta->pad_index,
+          (g_get_monotonic_time () - source->add_time_us) / 1000.0);
+      source->add_time_us = 0;
+    }
+    if ((source->last_frame_num >= 0) && (frame_meta->frame_num > source->last_frame_num + 1))
+      dropped_frame_cnt += frame_meta->frame_num - source->last_frame_num - 1;
+    source->last_frame_num = frame_meta->frame_num;
+  }
+
+  if (fpfilter_toggle_time_us)
+  {
+    g_print("fpfilter toggle latency: %.3f ms dropped frames: %u\n",
+        (g_get_monotonic_time () - fpfilter_toggle_time_us) / 1000.0,
+        dropped_frame_cnt - toggle_dropped_frame_cnt);
+    fpfilter_toggle_time_us = 0;
+  }
+  g_mutex_unlock(&fpfilter_toggle_mutex);
+}
+
 /* Store output in kitti format */
 static void
-write_kitti_output (gchar *output_path, guint config_index, NvDsBatchMeta *batch_meta)
+write_kitti_output (NvDsBatchMeta *batch_meta)
 {
   gchar bbox_file[1024] = { 0 };
   FILE *bbox_params_dump_file = NULL;
 
-  if (!output_path || (strlen(output_path) == 0))
-    return;
-
-  mkdir(output_path, 0700);
-
   for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
     NvDsFrameMeta *frame_meta = l_frame->data;
-    g_snprintf (bbox_file, sizeof (bbox_file) - 1, "%s/%06lu.txt", output_path, (gulong) frame_meta->frame_num);
+    if (frame_meta->pad_index >= MAX_NUM_SOURCES)
+      continue;
+
+    gchar *kitti_path = source_infos[frame_meta->pad_index].kitti_path;
+    if (strlen(kitti_path) == 0)
+      continue;
+
+    g_snprintf (bbox_file, sizeof (bbox_file) - 1, "%s/%06lu.txt", kitti_path, (gulong) frame_meta->frame_num);
     bbox_params_dump_file = fopen (bbox_file, "w");
     if (!bbox_params_dump_file)
       continue;
+    g_atomic_int_inc (&kitti_frames_written);
 
     for (NvDsMetaList * l_obj = frame_meta->obj_meta_list; l_obj != NULL;
         l_obj = l_obj->next) {
@@ -409,35 +1411,48 @@ save_frames_for_processing (NvDsBatchMeta *batch_meta)
   {
     NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) (l_frame->data);
     NvDsUserMetaList *frame_user_meta_list = NULL;
-    NvDsUserMeta *user_meta = NULL;
+    NvFpFilterMeta *fpfilter_meta = NULL;
     for (frame_user_meta_list = frame_meta->frame_user_meta_list; frame_user_meta_list != NULL; frame_user_meta_list = frame_user_meta_list->next)
     {
-      user_meta = (NvDsUserMeta *)frame_user_meta_list->data;
-      if (user_meta->base_meta.meta_type != NVFPFILTER_USER_META)
-        continue;
-    }
-
-    if (!user_meta)
-    {
-      return;
+      NvDsUserMeta *user_meta = (NvDsUserMeta *)frame_user_meta_list->data;
+      if (user_meta->base_meta.meta_type == NVFPFILTER_USER_META)
+      {
+        fpfilter_meta = (NvFpFilterMeta *) user_meta->user_meta_data;
+        break;
+      }
     }
-    NvFpFilterMeta *fpfilter_meta = (NvFpFilterMeta *) user_meta->user_meta_data;
-    g_print("frame_num: %d tp count: %d fp count: %d\n", frame_meta->frame_num, fpfilter_meta->tp_count, fpfilter_meta->fp_count);
 
-    if (!get_fpfilter_images_save_status())
+    /* Frames without fpfilter meta (e.g. while fpfilter is disabled) are skipped, not the batch */
+    if (!fpfilter_meta || (frame_meta->pad_index >= MAX_NUM_SOURCES))
       continue;
 
+    g_atomic_int_add (&stream_metrics[frame_meta->pad_index].fp_count, fpfilter_meta->fp_count);
+    g_atomic_int_add (&stream_metrics[frame_meta->pad_index].tp_count, fpfilter_meta->tp_count);
+    if (fp_stats_interval_s > 0)
+      fp_stats_add_frame (frame_meta->pad_index, fpfilter_meta->fp_count, fpfilter_meta->tp_count);
+    ASYNC_LOG (ASYNC_LOG_FRAME, "frame_num: %" G_GINT64_FORMAT " tp count: %" G_GINT64_FORMAT " fp count: %" G_GINT64_FORMAT "\n",
+        frame_meta->frame_num, fpfilter_meta->tp_count, fpfilter_meta->fp_count);
+
     guint total_objects = fpfilter_meta->tp_count + fpfilter_meta->fp_count;
+    if (mine_input)
+      dataset_miner_record_frame (frame_meta->pad_index, frame_meta->frame_num, frame_meta->buf_pts,
+          fpfilter_meta->fp_count, fpfilter_meta->tp_count, (fpfilter_meta->fp_count > 0) && (fpfilter_meta->fp_count >= mine_fp_ratio * total_objects));
     if (total_objects <= 1)
       continue;
 
     gdouble fp_percent = ((gdouble)fpfilter_meta->fp_count)/((gdouble) total_objects);
+    if (clip_recording && (fp_percent >= clip_fp_ratio))
+      clip_recorder_trigger ("false positive ratio");
+
+    if (!get_fpfilter_images_save_status())
+      continue;
+
     if (fp_percent >= FALSE_POSITIVE_PERCENTAGE_THRESHOLD)
     {
       FrameInfo *frame_info = (FrameInfo *) malloc(sizeof(FrameInfo));
       frame_info->frame_index = frame_meta->frame_num;
       frame_info->pad_index = frame_meta->pad_index;
-      frame_info->source = source_info;
+      frame_info->source = source_infos[frame_meta->pad_index].location;
       g_async_queue_push (frame_save_queue, frame_info);
       fpfilter_image_cnt++;
     }
@@ -448,16 +1463,283 @@ static GstPadProbeReturn
 after_filter_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
     gpointer u_data)
 {
-  GstBuffer *buf = (GstBuffer *) info->data;
-  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
-  write_kitti_output (output_path, 0, batch_meta);
-  save_frames_for_processing(batch_meta);
-  frame_number++;
-  g_print("frame number: %d\n", frame_number);
+  GstBuffer *buf = (GstBuffer *) info->data;
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = l_frame->data;
+    if (frame_meta->pad_index < MAX_NUM_SOURCES)
+      g_atomic_int_inc (&stream_metrics[frame_meta->pad_index].frames);
+  }
+
+  gint64 start_us = g_get_monotonic_time ();
+  write_kitti_output (batch_meta);
+  gint64 kitti_done_us = g_get_monotonic_time ();
+  save_frames_for_processing(batch_meta);
+  latency_stats_record (&stage_stats[STAGE_KITTI_WRITE], (kitti_done_us - start_us) * 1000);
+  latency_stats_record (&stage_stats[STAGE_SAVE_FRAMES], (g_get_monotonic_time () - kitti_done_us) * 1000);
+  update_fpfilter_toggle_stats(batch_meta);
+  frame_number++;
+  ASYNC_LOG (ASYNC_LOG_FRAME, "frame number: %" G_GINT64_FORMAT "\n", frame_number);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+count_muxed_frames_probe (GstPad * pad, GstPadProbeInfo * info, gpointer u_data)
+{
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (GST_PAD_PROBE_INFO_BUFFER (info));
+  if (batch_meta)
+    g_atomic_int_add (&muxed_frames, batch_meta->num_frames_in_batch);
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+append_stream_metric (GString *out, const gchar *name, const gchar *type, const gchar *help, gsize offset)
+{
+  g_string_append_printf (out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+  for (guint idx = 0; idx < MAX_NUM_SOURCES; idx++)
+  {
+    if (!g_atomic_int_get (&stream_metrics[idx].frames))
+      continue;
+    gint *value = (gint *) ((guint8 *) &stream_metrics[idx] + offset);
+    g_string_append_printf (out, "%s{stream=\"%d\"} %d\n", name, idx, g_atomic_int_get (value));
+  }
+}
+
+/* Formats metrics on the metrics server thread */
+static void
+write_metrics (GString *out)
+{
+  gint processed_frames = 0;
+
+  append_stream_metric (out, "deepstream_frames_total", "counter",
+      "Frames processed per stream.", G_STRUCT_OFFSET (StreamMetrics, frames));
+  append_stream_metric (out, "fpfilter_false_positives_total", "counter",
+      "Objects assessed as false positive by fpfilter.", G_STRUCT_OFFSET (StreamMetrics, fp_count));
+  append_stream_metric (out, "fpfilter_true_positives_total", "counter",
+      "Objects assessed as true positive by fpfilter.", G_STRUCT_OFFSET (StreamMetrics, tp_count));
+
+  /* Frames through the KITTI writer, for its lag behind streammux */
+  for (guint idx = 0; idx < MAX_NUM_SOURCES; idx++)
+    processed_frames += g_atomic_int_get (&stream_metrics[idx].frames);
+
+  g_string_append_printf (out, "# HELP frame_saver_upload_seconds_total Time spent saving and uploading frames.\n"
+      "# TYPE frame_saver_upload_seconds_total counter\nframe_saver_upload_seconds_total %.3f\n", get_upload_time_s ());
+
+  g_string_append_printf (out, "# HELP fpfilter_enabled Whether fpfilter is enabled.\n"
+      "# TYPE fpfilter_enabled gauge\nfpfilter_enabled %d\n", is_fpfilter_enabled ? 1 : 0);
+  g_string_append_printf (out, "# HELP frame_saver_queue_depth Frames waiting to be saved.\n"
+      "# TYPE frame_saver_queue_depth gauge\nframe_saver_queue_depth %d\n",
+      frame_save_queue ? g_async_queue_length (frame_save_queue) : 0);
+  g_string_append_printf (out, "# HELP frame_saver_saved_total Frames handed to the save script.\n"
+      "# TYPE frame_saver_saved_total counter\nframe_saver_saved_total %u\n", get_saved_frame_count ());
+  g_string_append_printf (out, "# HELP kitti_frames_written_total Frames written as KITTI labels.\n"
+      "# TYPE kitti_frames_written_total counter\nkitti_frames_written_total %d\n",
+      g_atomic_int_get (&kitti_frames_written));
+  g_string_append_printf (out, "# HELP kitti_writer_lag_frames Frames batched by streammux and not yet through the KITTI writer.\n"
+      "# TYPE kitti_writer_lag_frames gauge\nkitti_writer_lag_frames %d\n",
+      MAX (0, g_atomic_int_get (&muxed_frames) - g_atomic_int_get (&retired_frames) - processed_frames));
+
+  g_string_append_printf (out, "# HELP fpfilter_degradation_level Load shedding level, 0 is full assessment.\n"
+      "# TYPE fpfilter_degradation_level gauge\nfpfilter_degradation_level %u\n", load_shedder_get_level ());
+  g_string_append_printf (out, "# HELP fpfilter_cached_false_positives_total Objects removed by a cached static false positive verdict.\n"
+      "# TYPE fpfilter_cached_false_positives_total counter\nfpfilter_cached_false_positives_total %d\n",
+      g_atomic_int_get (&fp_cache_hits));
+  if (mask_prescore)
+  {
+    g_string_append_printf (out, "# HELP fpfilter_prescore_boxes_total Primary boxes scored from the mask pyramid.\n"
+        "# TYPE fpfilter_prescore_boxes_total counter\nfpfilter_prescore_boxes_total %d\n", g_atomic_int_get (&prescore_boxes));
+    g_string_append_printf (out, "# HELP fpfilter_prescore_rejected_total Primary boxes removed below seg-miou-threshold before fpfilter.\n"
+        "# TYPE fpfilter_prescore_rejected_total counter\nfpfilter_prescore_rejected_total %d\n", g_atomic_int_get (&prescore_rejected));
+    g_string_append_printf (out, "# HELP fpfilter_prescore_refined_total Primary boxes near the threshold refined at full mask resolution.\n"
+        "# TYPE fpfilter_prescore_refined_total counter\nfpfilter_prescore_refined_total %d\n", g_atomic_int_get (&prescore_refined));
+  }
+  if (clip_recording)
+    g_string_append_printf (out, "# HELP fpfilter_clips_recorded_total Clips recorded around false positive events.\n"
+        "# TYPE fpfilter_clips_recorded_total counter\nfpfilter_clips_recorded_total %u\n", clip_recorder_get_clips ());
+  if (fp_stats_interval_s > 0)
+  {
+    g_string_append_printf (out, "# HELP fpfilter_window_fp_rate False positive rate per stream over the last %u seconds.\n"
+        "# TYPE fpfilter_window_fp_rate gauge\n", fp_stats_get_window_s ());
+    for (guint idx = 0; idx < MAX_NUM_SOURCES; idx++)
+    {
+      FpStatsWindow window;
+      guint total = 0;
+      if (!fp_stats_get (idx, &window) || !(total = window.fp_count + window.tp_count))
+        continue;
+      g_string_append_printf (out, "fpfilter_window_fp_rate{stream=\"%d\"} %.4f\n", idx, (gdouble) window.fp_count / total);
+    }
+  }
+  if (fp_feedback_enabled)
+  {
+    g_string_append_printf (out, "# HELP fpfilter_feedback_tracks_total Tracks confirmed as false positive and sent to the tracker.\n"
+        "# TYPE fpfilter_feedback_tracks_total counter\nfpfilter_feedback_tracks_total %u\n", fp_feedback_get_confirmed ());
+    g_string_append (out, "# HELP fpfilter_feedback_dropped_total Detections of confirmed false positive tracks dropped at the tracker.\n"
+        "# TYPE fpfilter_feedback_dropped_total counter\n");
+    g_string_append_printf (out, "fpfilter_feedback_dropped_total{where=\"before-tracker\"} %u\n", fp_feedback_get_dropped (TRUE));
+    g_string_append_printf (out, "fpfilter_feedback_dropped_total{where=\"after-tracker\"} %u\n", fp_feedback_get_dropped (FALSE));
+  }
+
+  if (adaptive_batching)
+  {
+    BatchControllerState state;
+    batch_controller_get_state (&state);
+    g_string_append_printf (out, "# HELP deepstream_batch_push_timeout_us Streammux batched-push-timeout set by the batching controller.\n"
+        "# TYPE deepstream_batch_push_timeout_us gauge\ndeepstream_batch_push_timeout_us %u\n", state.timeout_us);
+    g_string_append_printf (out, "# HELP deepstream_batch_fill_ratio Frames per batch over batch-size in the last controller interval.\n"
+        "# TYPE deepstream_batch_fill_ratio gauge\ndeepstream_batch_fill_ratio %.4f\n", state.fill);
+    g_string_append (out, "# HELP deepstream_batch_timeout_adjustments_total Batched-push-timeout changes by the batching controller.\n"
+        "# TYPE deepstream_batch_timeout_adjustments_total counter\n");
+    g_string_append_printf (out, "deepstream_batch_timeout_adjustments_total{direction=\"up\"} %u\n", state.increases);
+    g_string_append_printf (out, "deepstream_batch_timeout_adjustments_total{direction=\"down\"} %u\n", state.decreases);
+    g_string_append (out, "# HELP deepstream_stream_arrival_fps Frames per second arriving in batches per stream.\n"
+        "# TYPE deepstream_stream_arrival_fps gauge\n");
+    /* Sources added at runtime take any free slot */
+    for (guint idx = 0; idx < MAX_NUM_SOURCES; idx++)
+      if (source_infos[idx].active)
+        g_string_append_printf (out, "deepstream_stream_arrival_fps{stream=\"%u\"} %.2f\n", idx, batch_controller_get_stream_fps (idx));
+  }
+
+  if (prefilter_config_file)
+  {
+    g_string_append (out, "# HELP prefilter_objects_total Primary objects per geometric pre-filter result.\n"
+        "# TYPE prefilter_objects_total counter\n");
+    for (guint idx = 0; idx < PREFILTER_RESULT_MAX; idx++)
+      g_string_append_printf (out, "prefilter_objects_total{result=\"%s\"} %u\n",
+          prefilter_result_name (idx), prefilter_get_count (idx));
+  }
+
+  g_string_append (out, "# HELP deepstream_queue_level_buffers Batches held by inserted queues.\n"
+      "# TYPE deepstream_queue_level_buffers gauge\n");
+  for (guint idx = 0; idx < QUEUE_MAX; idx++)
+  {
+    guint level = 0;
+    if (!stage_queues[idx])
+      continue;
+    g_object_get (G_OBJECT (stage_queues[idx]), "current-level-buffers", &level, NULL);
+    g_string_append_printf (out, "deepstream_queue_level_buffers{queue=\"%s\"} %u\n",
+        queue_point_names[idx], level);
+  }
+
+  g_string_append (out, "# HELP deepstream_stage_latency_seconds Per batch processing time.\n"
+      "# TYPE deepstream_stage_latency_seconds summary\n");
+  for (guint idx = 0; idx < STAGE_MAX; idx++)
+  {
+    static const gdouble quantiles[] = { 0.5, 0.9, 0.99 };
+    for (guint q = 0; q < G_N_ELEMENTS (quantiles); q++)
+      g_string_append_printf (out, "deepstream_stage_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+          stage_names[idx], quantiles[q],
+          latency_stats_percentile (&stage_stats[idx], quantiles[q] * 100) / 1000000000.0);
+    g_string_append_printf (out, "deepstream_stage_latency_seconds_sum{stage=\"%s\"} %.9f\n",
+        stage_names[idx], latency_stats_sum (&stage_stats[idx]) / 1000000000.0);
+    g_string_append_printf (out, "deepstream_stage_latency_seconds_count{stage=\"%s\"} %d\n",
+        stage_names[idx], g_atomic_int_get (&stage_stats[idx].count));
+  }
+}
+
+/* Creates the queues requested with --queues. Only time and buffers are
+ * bounded, a batch of NVMM buffers is small in bytes. */
+static gboolean
+create_stage_queues (void)
+{
+  if (!queue_points)
+    return TRUE;
+
+  gchar **points = g_strsplit (queue_points, ",", -1);
+  gboolean ret = TRUE;
+  for (guint i = 0; points[i]; i++)
+  {
+    gchar *point = g_strstrip (points[i]);
+    gboolean found = FALSE;
+    for (guint idx = 0; idx < QUEUE_MAX; idx++)
+    {
+      if (g_strcmp0 (point, "all") && g_strcmp0 (point, queue_point_names[idx]))
+        continue;
+      found = TRUE;
+      /* There is no encoder in metadata only mode */
+      if (stage_queues[idx] || (metadata_only && (idx == QUEUE_PRE_ENCODE)))
+        continue;
+      stage_queues[idx] = gst_element_factory_make ("queue", queue_point_names[idx]);
+      if (!stage_queues[idx])
+      {
+        g_printerr ("Failed to create queue %s\n", queue_point_names[idx]);
+        ret = FALSE;
+        goto done;
+      }
+      g_object_set (G_OBJECT (stage_queues[idx]), "max-size-buffers", queue_max_buffers,
+          "max-size-bytes", 0, "max-size-time", (guint64) 0,
+          "leaky", queue_leaky ? 2 : 0, NULL);
+    }
+    if (!found)
+    {
+      g_printerr ("Unknown queue point: %s\n", point);
+      ret = FALSE;
+      goto done;
+    }
+  }
+
+done:
+  g_strfreev (points);
+  return ret;
+}
+
+/* Prints fps and queue fill levels while the pipeline runs with --bench */
+static gboolean
+print_bench_stats (gpointer data)
+{
+  static guint prev_frames = 0;
+  static gint64 prev_time_us = 0;
+  gint64 now_us = g_get_monotonic_time ();
+  guint frames = g_atomic_int_get (&retired_frames);
+  GString *line = g_string_new (NULL);
+
+  for (guint idx = 0; idx < MAX_NUM_SOURCES; idx++)
+    frames += g_atomic_int_get (&stream_metrics[idx].frames);
+  if (prev_time_us)
+    g_string_append_printf (line, "bench: fps %.2f", (frames - prev_frames) * 1000000.0 / (now_us - prev_time_us));
+  else
+    g_string_append (line, "bench: fps -");
+  prev_frames = frames;
+  prev_time_us = now_us;
+
+  for (guint idx = 0; idx < QUEUE_MAX; idx++)
+  {
+    guint level = 0;
+    if (!stage_queues[idx])
+      continue;
+    g_object_get (G_OBJECT (stage_queues[idx]), "current-level-buffers", &level, NULL);
+    g_string_append_printf (line, " %s %u/%d", queue_point_names[idx], level, queue_max_buffers);
+  }
+  g_print ("%s\n", line->str);
+  g_string_free (line, TRUE);
+  return TRUE;
+}
+
+/* Posts the fp/tp statistics window of every active stream as element messages,
+ * from nvfpfilter while it is linked and from the pipeline otherwise */
+static gboolean
+post_fp_stats (gpointer data)
+{
+  GstElement *pipeline = (GstElement *) data;
+  GstElement *fpfilter = fpfilter_bin ? gst_bin_get_by_name (GST_BIN (fpfilter_bin), FPFILTER_ELEMENT_NAME) : NULL;
+  GstElement *poster = fpfilter ? fpfilter : pipeline;
 
-  return GST_PAD_PROBE_OK;
+  for (guint idx = 0; idx < MAX_NUM_SOURCES; idx++)
+  {
+    FpStatsWindow window;
+    if (!fp_stats_get (idx, &window))
+      continue;
+    gst_element_post_message (poster,
+        gst_message_new_element (GST_OBJECT (poster), fp_stats_new_structure (idx, &window)));
+  }
+
+  if (fpfilter)
+    gst_object_unref (fpfilter);
+  return TRUE;
 }
 
+static gboolean mine_source_failed (GstObject *src);
+
 static gboolean
 bus_call (GstBus * bus, GstMessage * msg, gpointer data)
 {
@@ -477,9 +1759,38 @@ bus_call (GstBus * bus, GstMessage * msg, gpointer data)
         g_printerr ("Error details: %s\n", debug);
       g_free (debug);
       g_error_free (error);
+      /* A broken item must not end the mining run */
+      if (mine_input && mine_source_failed (GST_MESSAGE_SRC (msg)))
+        break;
       g_main_loop_quit (loop);
       break;
     }
+    case GST_MESSAGE_WARNING:{
+      gchar *debug;
+      GError *error;
+      gst_message_parse_warning (msg, &error, &debug);
+      g_printerr ("WARNING from element %s: %s\n",
+          GST_OBJECT_NAME (msg->src), error->message);
+      g_free (debug);
+      g_error_free (error);
+      break;
+    }
+    case GST_MESSAGE_APPLICATION:{
+      const GstStructure *structure = gst_message_get_structure (msg);
+      if (gst_structure_has_name (structure, "fpfilter-degradation"))
+        g_print ("fpfilter degradation level %s\n", gst_structure_get_string (structure, "mode"));
+      break;
+    }
+    case GST_MESSAGE_ELEMENT:{
+      const GstStructure *structure = gst_message_get_structure (msg);
+      guint stream = 0, fp = 0, tp = 0;
+      gdouble fp_rate = 0;
+      if (gst_structure_has_name (structure, FP_STATS_MESSAGE_NAME) &&
+          gst_structure_get (structure, "stream", G_TYPE_UINT, &stream, "fp", G_TYPE_UINT, &fp,
+              "tp", G_TYPE_UINT, &tp, "fp-rate", G_TYPE_DOUBLE, &fp_rate, NULL))
+        g_print ("stream %u last %us: fp %u tp %u fp rate %.3f\n", stream, fp_stats_get_window_s (), fp, tp, fp_rate);
+      break;
+    }
     default:
       break;
   }
@@ -506,13 +1817,10 @@ seek_query_drop_prob (GstPad * pad, GstPadProbeInfo * info,
   return GST_PAD_PROBE_OK;
 }
 
-#ifdef MP4_SRC
-
-GstElement *mp4_h264parser = NULL;
-
 static void
 qtdemux_new_pad_cb (GstElement *element, GstPad *pad, gpointer data)
 {
+  GstElement *mp4_h264parser = (GstElement *) data;
   gchar *name = gst_pad_get_name (pad);
   if (strcmp (name, "video_0") == 0)
   {
@@ -534,10 +1842,9 @@ qtdemux_new_pad_cb (GstElement *element, GstPad *pad, gpointer data)
 
 /* Create mp4 source element */
 static GstElement *
-create_source_bin(gchar *bin_name, gchar *location)
+create_mp4_source_bin(gchar *bin_name, gchar *location)
 {
-  GstElement *bin = NULL, *source = NULL, *decoder = NULL, *qtdemux = NULL;
-  gboolean multi_file_src = FALSE;
+  GstElement *bin = NULL, *source = NULL, *decoder = NULL, *qtdemux = NULL, *mp4_h264parser = NULL;
 
   /* Create a source GstBin to abstract this bin's content from the rest of the pipeline */
   bin = gst_bin_new (bin_name);
@@ -566,7 +1873,7 @@ create_source_bin(gchar *bin_name, gchar *location)
   gst_element_link_many (source, qtdemux, NULL);
   gst_element_link_many (mp4_h264parser, decoder, NULL);
 
-  g_signal_connect (qtdemux, "pad-added", G_CALLBACK (qtdemux_new_pad_cb), NULL);
+  g_signal_connect (qtdemux, "pad-added", G_CALLBACK (qtdemux_new_pad_cb), mp4_h264parser);
 
   /* Create a ghost pad for bin */
   GstPad *decoder_srcpad = gst_element_get_static_pad (decoder, "src");
@@ -587,15 +1894,12 @@ done:
 
   return bin;
 }
-#endif /* MP4_SRC */
 
-#ifdef H264_ELEMENTARY_SRC
 /* Create elementary h264 source element */
 static GstElement *
-create_source_bin(gchar *bin_name, gchar *location)
+create_h264_source_bin(gchar *bin_name, gchar *location)
 {
   GstElement *bin = NULL, *source = NULL, *h264parser = NULL, *decoder = NULL;
-  gboolean multi_file_src = FALSE;
 
   /* Create a source GstBin to abstract this bin's content from the rest of the pipeline */
   bin = gst_bin_new (bin_name);
@@ -639,12 +1943,10 @@ done:
 
   return bin;
 }
-#endif
 
-#ifdef MULTI_FILE_SRC
 /* Create elementary multifile source element */
 static GstElement *
-create_source_bin(gchar *bin_name, gchar *location)
+create_multi_file_source_bin(gchar *bin_name, gchar *location)
 {
   GstElement *bin = NULL, *source = NULL, *jpegparser = NULL, *decoder = NULL, *cap_filter=NULL;
   GstCaps *caps = NULL;
@@ -685,6 +1987,9 @@ create_source_bin(gchar *bin_name, gchar *location)
   }
 
   g_object_set (G_OBJECT (source), "location", location, NULL);
+  /* A location without index pattern is a single image, read it once */
+  if (!strchr (location, '%'))
+    g_object_set (G_OBJECT (source), "stop-index", 0, NULL);
 
   if(prop.integrated) {
     g_object_set (G_OBJECT (decoder), "mjpeg", 1, NULL);
@@ -714,12 +2019,204 @@ done:
 
   return bin;
 }
-#endif //MULTI_FILE_SRC
 
-#ifdef VIDEO_RENDER_SINK
+/* Mining: images pushed into the source of each image slot, the pts of an image is its
+ * position in the slot's stream */
+#define MINE_IMAGE_DURATION   (GST_SECOND / 30)
+static guint64 mine_images_pushed[MAX_NUM_SOURCES];
+
+/* Mining: pushes the next image of the slot, the slot's first image is its location */
+static void
+mine_need_data_cb (GstElement *appsrc, guint length, gpointer user_data)
+{
+  guint slot = GPOINTER_TO_UINT (user_data);
+
+  while (TRUE) {
+    guint64 pts = mine_images_pushed[slot] * MINE_IMAGE_DURATION;
+    const gchar *location = mine_images_pushed[slot] ? dataset_miner_next_image (slot, pts) :
+        source_infos[slot].location;
+    GstFlowReturn flow = GST_FLOW_OK;
+    if (!location) {
+      g_signal_emit_by_name (appsrc, "end-of-stream", &flow);
+      return;
+    }
+    mine_images_pushed[slot]++;
+
+    /* An unreadable image gives no frame and is checkpointed as failed */
+    gchar *contents = NULL;
+    gsize len = 0;
+    if (!g_file_get_contents (location, &contents, &len, NULL)) {
+      g_printerr ("Failed to read %s\n", location);
+      continue;
+    }
+    GstBuffer *buf = gst_buffer_new_wrapped (contents, len);
+    GST_BUFFER_PTS (buf) = pts;
+    GST_BUFFER_DURATION (buf) = MINE_IMAGE_DURATION;
+    g_signal_emit_by_name (appsrc, "push-buffer", buf, &flow);
+    gst_buffer_unref (buf);
+    return;
+  }
+}
+
+/* Mining: one source for all images of a slot, so an image costs a buffer instead of
+ * a source bin and a decoder */
+static GstElement *
+create_mine_image_source_bin(gchar *bin_name, guint slot)
+{
+  GstElement *bin = NULL, *source = NULL, *jpegparser = NULL, *decoder = NULL;
+  GstCaps *caps = NULL;
+
+  int current_device = -1;
+  cudaGetDevice(&current_device);
+  struct cudaDeviceProp prop;
+  cudaGetDeviceProperties(&prop, current_device);
+
+  bin = gst_bin_new (bin_name);
+  source = gst_element_factory_make("appsrc", "source");
+  if (!source)
+  {
+    g_printerr ("appsrc create failed. Exiting.\n");
+    return NULL;
+  }
+
+  caps = gst_caps_from_string ("image/jpeg,framerate=30/1");
+  g_object_set (G_OBJECT (source), "caps", caps, "format", GST_FORMAT_TIME, NULL);
+  if (caps)
+    gst_caps_unref (caps);
+  mine_images_pushed[slot] = 0;
+  g_signal_connect (source, "need-data", G_CALLBACK (mine_need_data_cb), GUINT_TO_POINTER (slot));
+
+  jpegparser = gst_element_factory_make ("jpegparse", "jpeg-parser");
+  if (!jpegparser)
+  {
+    g_printerr ("jpegparse create failed. Exiting.\n");
+    return NULL;
+  }
+
+  decoder = gst_element_factory_make ("nvv4l2decoder", "nvv4l2-decoder");
+  if (!decoder)
+  {
+    g_printerr ("nvv4l2decoder create failed. Exiting.\n");
+    return NULL;
+  }
+
+  if(prop.integrated) {
+    g_object_set (G_OBJECT (decoder), "mjpeg", 1, NULL);
+  }
+
+  gst_bin_add_many (GST_BIN (bin), source, jpegparser, decoder, NULL);
+
+  gst_element_link_many (source, jpegparser, decoder, NULL);
+
+  GstPad *decoder_srcpad = gst_element_get_static_pad (decoder, "src");
+  if (!decoder_srcpad) {
+    g_printerr ("Failed to get src pad of source bin. Exiting.\n");
+    return NULL;
+  }
+
+  if (!gst_element_add_pad (bin, gst_ghost_pad_new ("src", decoder_srcpad))) {
+    g_printerr ("Failed to add ghost pad in source bin\n");
+    bin = NULL;
+  }
+
+  gst_object_unref(decoder_srcpad);
+  return bin;
+}
+
+static void
+uridecodebin_new_pad_cb (GstElement *element, GstPad *pad, gpointer data)
+{
+  GstElement *bin = (GstElement *) data;
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  if (!caps)
+    caps = gst_pad_query_caps (pad, NULL);
+
+  GstStructure *str = gst_caps_get_structure (caps, 0);
+  const gchar *name = gst_structure_get_name (str);
+  GstCapsFeatures *features = gst_caps_get_features (caps, 0);
+
+  /* Link only video decoded by nvidia decoder, which outputs NVMM memory */
+  if (!strncmp (name, "video", 5))
+  {
+    if (gst_caps_features_contains (features, "memory:NVMM"))
+    {
+      GstPad *bin_ghost_pad = gst_element_get_static_pad (bin, "src");
+      if (!gst_ghost_pad_set_target (GST_GHOST_PAD (bin_ghost_pad), pad))
+        g_printerr ("Failed to link decoder src pad to source bin ghost pad\n");
+      gst_object_unref (bin_ghost_pad);
+    }
+    else
+    {
+      g_printerr ("Error: Decodebin did not pick nvidia decoder plugin.\n");
+    }
+  }
+  gst_caps_unref (caps);
+}
+
+/* Create source element for any uri uridecodebin can handle, e.g. rtsp */
+static GstElement *
+create_uri_source_bin(gchar *bin_name, gchar *location)
+{
+  GstElement *bin = NULL, *uri_decode_bin = NULL;
+  gchar *uri = NULL;
+
+  /* Create a source GstBin to abstract this bin's content from the rest of the pipeline */
+  bin = gst_bin_new (bin_name);
+  uri_decode_bin = gst_element_factory_make ("uridecodebin", "uri-decode-bin");
+  if (!uri_decode_bin)
+  {
+    g_printerr ("uridecodebin create failed. Exiting.\n");
+    return NULL;
+  }
+
+  uri = gst_uri_is_valid (location) ? g_strdup (location) : gst_filename_to_uri (location, NULL);
+  if (!uri)
+  {
+    g_printerr ("Invalid input location: %s\n", location);
+    return NULL;
+  }
+  g_object_set (G_OBJECT (uri_decode_bin), "uri", uri, NULL);
+  g_free (uri);
+
+  g_signal_connect (uri_decode_bin, "pad-added", G_CALLBACK (uridecodebin_new_pad_cb), bin);
+
+  gst_bin_add (GST_BIN (bin), uri_decode_bin);
+
+  /* Ghost pad gets its target once the decoder pad is added */
+  if (!gst_element_add_pad (bin, gst_ghost_pad_new_no_target ("src", GST_PAD_SRC))) {
+    g_printerr ("Failed to add ghost pad in source bin\n");
+    return NULL;
+  }
+
+  return bin;
+}
+
+/* Picks the source bin from the input uri or file type */
+static GstElement *
+create_source_bin(gchar *bin_name, gchar *location)
+{
+  gchar *lower = g_ascii_strdown (location, -1);
+  GstElement *bin = NULL;
+
+  if (g_str_has_prefix (lower, "rtsp://") || g_str_has_prefix (lower, "file://") ||
+      g_str_has_prefix (lower, "http://") || g_str_has_prefix (lower, "https://"))
+    bin = create_uri_source_bin (bin_name, location);
+  else if (g_str_has_suffix (lower, ".mp4") || g_str_has_suffix (lower, ".mov"))
+    bin = create_mp4_source_bin (bin_name, location);
+  else if (g_str_has_suffix (lower, ".h264") || g_str_has_suffix (lower, ".264"))
+    bin = create_h264_source_bin (bin_name, location);
+  else if (g_str_has_suffix (lower, ".jpg") || g_str_has_suffix (lower, ".jpeg"))
+    bin = create_multi_file_source_bin (bin_name, location);
+  else
+    bin = create_uri_source_bin (bin_name, location);
+
+  g_free (lower);
+  return bin;
+}
+
 /* out_name will be ignored if the sink is video renderer */
 static GstElement *
-create_sink_bin (gchar *sink_name, gchar *out_name)
+create_render_sink_bin (gchar *sink_name, gchar *out_name)
 {
   GstElement *bin = NULL, *sink=NULL, *transform=NULL;
 
@@ -796,11 +2293,9 @@ done:
   return bin;
 }
 
-#endif //VIDEO_RENDER_SINK
 
-#ifdef FILE_SINK
 static GstElement *
-create_sink_bin (gchar *bin_name, gchar *out_name)
+create_file_sink_bin (gchar *bin_name, gchar *out_name)
 {
   GstElement *bin = NULL;
   GstCaps *caps = NULL;
@@ -837,6 +2332,7 @@ create_sink_bin (gchar *bin_name, gchar *out_name)
   }
   probe_id = gst_pad_add_probe(gstpad, GST_PAD_PROBE_TYPE_QUERY_UPSTREAM, seek_query_drop_prob, NULL, NULL);
   gst_object_unref (gstpad);
+  latency_tracer_add_element (sink_encoder, "encoder");
 
   if(prop.integrated) {
     g_object_set (G_OBJECT (sink_encoder), "bufapi-version", 1, NULL);
@@ -852,85 +2348,360 @@ create_sink_bin (gchar *bin_name, gchar *out_name)
     return NULL;
   }
 
-  sink_mux = gst_element_factory_make ("qtmux", "qtmux-sink");
-  if (!sink_mux) {
-    g_printerr("Failed to create '%s'", "qtmux-sink");
+  /* Clips are muxed by the clip recorder, the encoded stream itself ends here */
+  if (clip_recording) {
+    /* Every clip starts at a key frame of the ring and must decode on its own: key
+     * frames are IDR frames, each one preceded by SPS/PPS */
+    g_object_set (G_OBJECT (sink_encoder), "idrinterval", 30, NULL);
+    g_object_set (G_OBJECT (sink_codecparse), "config-interval", -1, NULL);
+    sink = gst_element_factory_make ("fakesink", "clip-sink");
+    if (!sink || !clip_recorder_attach (sink_codecparse)) {
+      g_printerr("Failed to create '%s'", "clip-sink");
+      return NULL;
+    }
+    g_object_set (G_OBJECT (sink), "sync", FALSE, "async", FALSE, NULL);
+    gst_bin_add_many (GST_BIN (bin), sink_cap_filter, sink_encoder, sink_codecparse, sink, NULL);
+    if (!gst_element_link_many (sink_cap_filter, sink_encoder, sink_codecparse, sink, NULL)) {
+      g_printerr ("Elements could not be linked: 2. Exiting.\n");
+      return NULL;
+    }
+  } else {
+    sink_mux = gst_element_factory_make ("qtmux", "qtmux-sink");
+    if (!sink_mux) {
+      g_printerr("Failed to create '%s'", "qtmux-sink");
+      return NULL;
+    }
+
+    sink = gst_element_factory_make ("filesink", "file-sink");
+    if (!sink) {
+      g_printerr("Failed to create '%s'", "file-sink");
+      return NULL;
+    }
+
+    g_object_set (G_OBJECT (sink), "location", out_name, "sync", FALSE, "async", FALSE, NULL);
+
+    gst_bin_add_many (GST_BIN (bin), sink_cap_filter, sink_encoder, sink_codecparse, sink_mux, sink, NULL);
+
+    if (!gst_element_link_many (sink_cap_filter, sink_encoder, sink_codecparse, sink_mux, sink, NULL)) {
+      g_printerr ("Elements could not be linked: 2. Exiting.\n");
+      return NULL;
+    }
+  }
+
+  /* Create a ghost pad for bin */
+  GstPad *sinkpad = gst_element_get_static_pad (sink_cap_filter, "sink");
+  if (!sinkpad) {
+    g_printerr ("Failed to get sink pad of filter element. Exiting.\n");
     return NULL;
   }
 
-  sink = gst_element_factory_make ("filesink", "file-sink");
+  if (!gst_element_add_pad (bin, gst_ghost_pad_new ("sink", sinkpad))) {
+    g_printerr ("Failed to add ghost pad in sink bin\n");
+    bin = NULL;
+    goto done;
+  }
+
+done:
+  if (sinkpad)
+    gst_object_unref (sinkpad);
+
+  if (caps) {
+    gst_caps_unref (caps);
+  }
+  return bin;
+}
+
+
+/* Fake sink keeps the full output path (conversions, OSD) but discards the frames */
+static GstElement *
+create_fake_sink_bin (gchar *bin_name, gchar *out_name)
+{
+  GstElement *sink = gst_element_factory_make ("fakesink", bin_name);
   if (!sink) {
-    g_printerr("Failed to create '%s'", "file-sink");
+    g_printerr("Failed to create '%s'", bin_name);
     return NULL;
   }
+  g_object_set (G_OBJECT (sink), "sync", FALSE, "async", FALSE, NULL);
+  return sink;
+}
 
-  g_object_set (G_OBJECT (sink), "location", out_name, "sync", FALSE, "async", FALSE, NULL);
+static GstElement *
+create_sink_bin (gchar *bin_name, gchar *out_name)
+{
+  if (!g_strcmp0 (sink_type, SINK_TYPE_FILE) || clip_recording)
+    return create_file_sink_bin (bin_name, out_name);
+  else if (!g_strcmp0 (sink_type, SINK_TYPE_DISPLAY))
+    return create_render_sink_bin (bin_name, out_name);
+  else if (!g_strcmp0 (sink_type, SINK_TYPE_FAKE) || !g_strcmp0 (sink_type, SINK_TYPE_NONE))
+    return create_fake_sink_bin (bin_name, out_name);
+
+  g_printerr ("Unknown sink type: %s\n", sink_type);
+  return NULL;
+}
 
-  gst_bin_add_many (GST_BIN (bin), sink_cap_filter, sink_encoder, sink_codecparse, sink_mux, sink, NULL);
+/* Creates source bin for the input and links it to streammux sink pad of given index */
+static gboolean
+add_source(GstElement *pipeline, GstElement *streammux, guint index, const gchar *location)
+{
+  gchar bin_name[32] = {0,};
+  gchar pad_name[16] = {0,};
+  GstPad *sinkpad = NULL, *srcpad = NULL;
+  gboolean ret = FALSE;
+  SourceInfo *source_info = &source_infos[index];
+
+  g_snprintf (source_info->location, sizeof (source_info->location), "%s", location);
+  source_info->last_frame_num = -1;
+  fp_cache_clear_stream (index);
+  fp_feedback_clear_stream (index);
+  fp_stats_clear_stream (index);
+  /* A reused slot starts as a new stream */
+  g_atomic_int_add (&retired_frames, g_atomic_int_get (&stream_metrics[index].frames));
+  g_atomic_int_set (&stream_metrics[index].frames, 0);
+  g_atomic_int_set (&stream_metrics[index].fp_count, 0);
+  g_atomic_int_set (&stream_metrics[index].tp_count, 0);
+  set_fpfilter_stream_enabled (index, TRUE);
+  source_info->add_time_us = g_get_monotonic_time ();
+
+  /* Keep single source kitti labels directly in the output directory */
+  if (strlen(output_path) == 0)
+    source_info->kitti_path[0] = '\0';
+  else if ((source_slots == 1) && (index == 0))
+    g_snprintf (source_info->kitti_path, sizeof (source_info->kitti_path), "%s", output_path);
+  else
+    g_snprintf (source_info->kitti_path, sizeof (source_info->kitti_path), "%s/stream_%u", output_path, index);
 
-  if (!gst_element_link_many (sink_cap_filter, sink_encoder, sink_codecparse, sink_mux, sink, NULL)) {
-    g_printerr ("Elements could not be linked: 2. Exiting.\n");
-    return NULL;
+  if (strlen(source_info->kitti_path) != 0)
+  {
+    mkdir(output_path, 0700);
+    mkdir(source_info->kitti_path, 0700);
   }
 
-  /* Create a ghost pad for bin */
-  GstPad *sinkpad = gst_element_get_static_pad (sink_cap_filter, "sink");
+  g_snprintf (bin_name, sizeof (bin_name), "source-bin-%02u", index);
+  GstElement *source = (mine_input && dataset_miner_is_image (location)) ?
+      create_mine_image_source_bin (bin_name, index) : create_source_bin (bin_name, source_info->location);
+  if (!source) {
+    g_printerr ("Failed to create source bin. Exiting.\n");
+    return FALSE;
+  }
+  gst_bin_add (GST_BIN (pipeline), source);
+  source_info->source_bin = source;
+
+  g_snprintf (pad_name, sizeof (pad_name), "sink_%u", index);
+  sinkpad = gst_element_get_request_pad (streammux, pad_name);
   if (!sinkpad) {
-    g_printerr ("Failed to get sink pad of filter element. Exiting.\n");
-    return NULL;
+    g_printerr ("Streammux request sink pad failed. Exiting.\n");
+    goto done;
+  }
+
+  srcpad = gst_element_get_static_pad (source, "src");
+  if (!srcpad) {
+    g_printerr ("Decoder request src pad failed. Exiting.\n");
+    goto done;
+  }
+
+  if (gst_pad_link (srcpad, sinkpad) != GST_PAD_LINK_OK) {
+    g_printerr ("Failed to link decoder to stream muxer. Exiting.\n");
+    goto done;
+  }
+
+  source_info->active = TRUE;
+  ret = TRUE;
+done:
+  /* Leave nothing behind on failure, so the slot can be used again */
+  if (!ret)
+  {
+    if (sinkpad)
+      gst_element_release_request_pad (streammux, sinkpad);
+    gst_bin_remove (GST_BIN (pipeline), source);
+    source_info->source_bin = NULL;
+  }
+  if (sinkpad)
+    gst_object_unref (sinkpad);
+  if (srcpad)
+    gst_object_unref (srcpad);
+  return ret;
+}
+
+/* Stops source bin, delivers EOS for its stream and releases its streammux pad */
+static gboolean
+remove_source(GstElement *pipeline, GstElement *streammux, guint index)
+{
+  gchar pad_name[16] = {0,};
+  SourceInfo *source_info = &source_infos[index];
+
+  if (!source_info->active)
+  {
+    g_print("source %u is not active\n", index);
+    return FALSE;
   }
 
-  if (!gst_element_add_pad (bin, gst_ghost_pad_new ("sink", sinkpad))) {
-    g_printerr ("Failed to add ghost pad in sink bin\n");
-    bin = NULL;
-    goto done;
+  gst_element_set_state (source_info->source_bin, GST_STATE_NULL);
+
+  g_snprintf (pad_name, sizeof (pad_name), "sink_%u", index);
+  GstPad *sinkpad = gst_element_get_static_pad (streammux, pad_name);
+  if (sinkpad)
+  {
+    /* streammux forwards it downstream as EOS of this stream only */
+    if (!GST_PAD_IS_EOS (sinkpad))
+      gst_pad_send_event (sinkpad, gst_event_new_eos ());
+    gst_element_release_request_pad (streammux, sinkpad);
+    gst_object_unref (sinkpad);
+  }
+
+  gst_bin_remove (GST_BIN (pipeline), source_info->source_bin);
+  source_info->source_bin = NULL;
+  source_info->active = FALSE;
+  g_print("source %u removed\n", index);
+  return TRUE;
+}
+
+typedef struct {
+  gboolean add;
+  guint index;
+  gchar *location;
+} SourceRequest;
+
+/* Source add/remove requests run on the main loop, serialized with each other */
+static gboolean
+handle_source_request(gpointer user_data)
+{
+  SourceRequest *request = (SourceRequest *) user_data;
+
+  if (request->add)
+  {
+    guint index = 0;
+    while ((index < source_slots) && source_infos[index].active)
+      index++;
+
+    if ((index < source_slots) && add_source(app_pipeline, app_streammux, index, request->location))
+    {
+      gst_element_sync_state_with_parent (source_infos[index].source_bin);
+      g_print("source %u added: %s\n", index, request->location);
+    }
+    else
+    {
+      g_printerr("source %s could not be added\n", request->location);
+      g_atomic_int_inc (&free_source_slots);
+    }
+  }
+  else if (request->index < source_slots)
+  {
+    if (remove_source(app_pipeline, app_streammux, request->index))
+      g_atomic_int_inc (&free_source_slots);
+  }
+
+  g_free (request->location);
+  free (request);
+  /* return false to avoid calling this function repeateadly */
+  return FALSE;
+}
+
+/* Mining: replaces the source of a finished slot with the next item */
+static gboolean
+mine_next_item(gpointer user_data)
+{
+  guint slot = GPOINTER_TO_UINT (user_data);
+
+  if (source_infos[slot].active)
+    remove_source (app_pipeline, app_streammux, slot);
+  const gchar *location = dataset_miner_start_slot (slot);
+  if (!location)
+    return FALSE;
+
+  if (add_source (app_pipeline, app_streammux, slot, location))
+    gst_element_sync_state_with_parent (source_infos[slot].source_bin);
+  else
+    g_printerr ("Failed to add %s for mining\n", location);
+  return FALSE;
+}
+
+/* Mining: checkpoints the item of the slot whose source posted an error as failed and
+ * removes the source. Its stream EOS then refills the slot. Returns FALSE if src is
+ * not inside a source bin. */
+static gboolean
+mine_source_failed (GstObject *src)
+{
+  for (guint slot = 0; slot < MAX_NUM_SOURCES; slot++) {
+    SourceInfo *source_info = &source_infos[slot];
+    if (!source_info->active || !gst_object_has_as_ancestor (src, GST_OBJECT (source_info->source_bin)))
+      continue;
+    g_printerr ("mining: source %u failed\n", slot);
+    dataset_miner_fail_slot (slot);
+    remove_source (app_pipeline, app_streammux, slot);
+    return TRUE;
   }
+  return FALSE;
+}
 
-done:
-  if (sinkpad)
-    gst_object_unref (sinkpad);
+/* Mining: stream EOS behind fpfilter means all verdicts of the slot's item are in */
+static GstPadProbeReturn
+mine_stream_eos_probe (GstPad * pad, GstPadProbeInfo * info, gpointer u_data)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  guint source_id = 0;
 
-  if (caps) {
-    gst_caps_unref (caps);
-  }
-  return bin;
+  if (GST_EVENT_TYPE (event) != GST_NVEVENT_STREAM_EOS)
+    return GST_PAD_PROBE_OK;
+
+  gst_nvevent_parse_stream_eos (event, &source_id);
+  if (dataset_miner_finish_slot (source_id))
+    g_idle_add (mine_next_item, GUINT_TO_POINTER (source_id));
+  return GST_PAD_PROBE_OK;
 }
 
-#endif //FILE_SINK
+/* Mining: streammux sends EOS once all its pads are at EOS, which also happens
+ * while items still wait for a slot */
+static GstPadProbeReturn
+mine_eos_drop_probe (GstPad * pad, GstPadProbeInfo * info, gpointer u_data)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+  if ((GST_EVENT_TYPE (event) == GST_EVENT_EOS) && dataset_miner_get_pending ())
+    return GST_PAD_PROBE_DROP;
+  return GST_PAD_PROBE_OK;
+}
 
-static void
+/* Returns NULL when every entry of the message was handled, else the reason of the
+ * first entry that was not, which the prompt handler sends back instead of the ack */
+static const gchar *
 handle_usr_prompt(guchar *msg, guint len)
 {
+  const gchar *status = NULL;
   g_print("%s\n", msg);
 
   JsonParser *parser = json_parser_new ();
-  GError *error;
+  GError *error = NULL;
   gboolean result = json_parser_load_from_data (parser, (const gchar *) msg, len, &error);
   if (!result)
   {
     g_print("message parse failed\n");
-    return;
+    g_error_free (error);
+    status = "parse failed";
+    goto done;
   }
 
   JsonNode *root_node = json_parser_get_root (parser);
   if (!JSON_NODE_HOLDS_OBJECT(root_node))
   {
     g_print("message parse error\n");
-    return;
+    status = "not a json object";
+    goto done;
   }
 
   JsonObject *root_object = json_node_get_object (root_node);
   if (!json_object_has_member (root_object, USR_PROMPT_KEY_MESSAGE))
   {
     g_print("message parse error: no message object\n");
-    return;
+    status = "no message object";
+    goto done;
   }
 
   JsonNode *arr_node = json_object_get_member (root_object, USR_PROMPT_KEY_MESSAGE);
   if (!JSON_NODE_HOLDS_ARRAY(arr_node))
   {
     g_print("message parse error: message\n");
-    return;
+    status = "message is not an array";
+    goto done;
   }
 
   JsonArray *arr = json_node_get_array (arr_node);
@@ -941,6 +2712,7 @@ handle_usr_prompt(guchar *msg, guint len)
     if (!json_object_has_member (arr_obj, USR_PROMPT_KEY_TARGET))
     {
       g_print("message parse error: no target object\n");
+      status = status ? status : "no target";
       continue;
     }
 
@@ -950,6 +2722,7 @@ handle_usr_prompt(guchar *msg, guint len)
       if (!json_object_has_member (arr_obj, USR_PROMPT_KEY_ACTION))
       {
         g_print("action not found\n");
+        status = status ? status : "no action";
         continue;
       }
       const gchar *action = json_object_get_string_member (arr_obj, USR_PROMPT_KEY_ACTION);
@@ -979,10 +2752,94 @@ handle_usr_prompt(guchar *msg, guint len)
       {
         disable_fpfilter_images_save();
       }
+      else if (!g_strcmp0(action, USR_PROMPT_KEY_STATS))
+      {
+        print_stage_stats();
+      }
+      else if (!g_strcmp0(action, USR_PROMPT_KEY_STATS_RESET))
+      {
+        reset_stage_stats();
+      }
+      else if (!g_strcmp0(action, USR_PROMPT_KEY_LATENCY))
+      {
+        latency_tracer_print();
+      }
+      else if (!g_strcmp0(action, USR_PROMPT_KEY_RECORD_CLIP))
+      {
+        if (clip_recording)
+          clip_recorder_trigger ("user prompt");
+        else
+        {
+          g_print("clip recording needs --sink=clips\n");
+          status = status ? status : "clip recording needs --sink=clips";
+        }
+      }
+      else if (!g_strcmp0(action, USR_PROMPT_KEY_STREAM_ENABLE) || !g_strcmp0(action, USR_PROMPT_KEY_STREAM_DISABLE))
+      {
+        if (!json_object_has_member (arr_obj, USR_PROMPT_KEY_SOURCES))
+        {
+          g_print("sources not found\n");
+          status = status ? status : "no sources";
+          continue;
+        }
+        JsonArray *sources = json_object_get_array_member (arr_obj, USR_PROMPT_KEY_SOURCES);
+        for (guint src_idx = 0; src_idx < json_array_get_length (sources); src_idx++)
+          set_fpfilter_stream_enabled ((guint) json_array_get_int_element (sources, src_idx),
+              !g_strcmp0(action, USR_PROMPT_KEY_STREAM_ENABLE));
+      }
+      else
+      {
+        g_print("unknown action: %s\n", action);
+        status = status ? status : "unknown action";
+      }
+    }
+    else if (!g_strcmp0(target, "source"))
+    {
+      if (!json_object_has_member (arr_obj, USR_PROMPT_KEY_ACTION))
+      {
+        g_print("action not found\n");
+        status = status ? status : "no action";
+        continue;
+      }
+      const gchar *action = json_object_get_string_member (arr_obj, USR_PROMPT_KEY_ACTION);
+      SourceRequest *request = (SourceRequest *) calloc(1, sizeof(SourceRequest));
+      if (!g_strcmp0(action, USR_PROMPT_KEY_ADD) && json_object_has_member (arr_obj, USR_PROMPT_KEY_LOCATION))
+      {
+        /* Reserve a slot now so that the ack reports a full pipeline */
+        if (g_atomic_int_add (&free_source_slots, -1) <= 0)
+        {
+          g_atomic_int_inc (&free_source_slots);
+          g_print("no free source slot, see --max-sources\n");
+          status = status ? status : "no free source slot";
+          free (request);
+          continue;
+        }
+        request->add = TRUE;
+        request->location = g_strdup (json_object_get_string_member (arr_obj, USR_PROMPT_KEY_LOCATION));
+      }
+      else if (!g_strcmp0(action, USR_PROMPT_KEY_REMOVE) && json_object_has_member (arr_obj, USR_PROMPT_KEY_ID))
+      {
+        request->index = (guint) json_object_get_int_member (arr_obj, USR_PROMPT_KEY_ID);
+      }
+      else
+      {
+        g_print("invalid source message\n");
+        status = status ? status : "invalid source message";
+        free (request);
+        continue;
+      }
+      g_idle_add (handle_source_request, request);
+    }
+    else
+    {
+      g_print("unknown target: %s\n", target);
+      status = status ? status : "unknown target";
     }
   }
 
+done:
   g_object_unref(parser);
+  return status;
 }
 
 gboolean get_fpfilter_status_from_cfg_file(const gchar *cfg_file_path)
@@ -1058,29 +2915,225 @@ done:
   return pgie_id;
 }
 
+/* Returns seg-miou-threshold, or -1 if a box failing the segmentation check may still be
+ * kept: with bbox assessors, whose support can keep it, with tracker filtering, which
+ * decides over several frames, or when the segmentation check is disabled */
+gdouble get_seg_miou_threshold_from_cfg_file(const gchar *cfg_file_path)
+{
+  GKeyFile *key_file = g_key_file_new ();
+  GError *error = NULL;
+  gdouble threshold = -1;
+
+  if (!g_key_file_load_from_file (key_file, cfg_file_path, G_KEY_FILE_NONE, &error))
+  {
+    g_printerr ("Failed to load config file: %s\n", error->message);
+    goto done;
+  }
+
+  if (!g_key_file_has_group (key_file, CONFIG_GROUP_PROPERTY))
+  {
+    g_printerr ("Could not find group %s\n", CONFIG_GROUP_PROPERTY);
+    goto done;
+  }
+
+  if (g_key_file_has_key (key_file, CONFIG_GROUP_PROPERTY, CONFIG_PROPERTY_BBOX_ASSESSOR_IDS, NULL))
+    goto done;
+
+  if (g_key_file_has_key (key_file, CONFIG_GROUP_PROPERTY, CONFIG_PROPERTY_ENABLE_SEG_MASK_FILTERING, NULL) &&
+      !g_key_file_get_boolean (key_file, CONFIG_GROUP_PROPERTY, CONFIG_PROPERTY_ENABLE_SEG_MASK_FILTERING, &error))
+    goto done;
+
+  if (g_key_file_has_key (key_file, CONFIG_GROUP_PROPERTY, CONFIG_PROPERTY_ENABLE_TRACKER_FILTERING, NULL) &&
+      (g_key_file_get_boolean (key_file, CONFIG_GROUP_PROPERTY, CONFIG_PROPERTY_ENABLE_TRACKER_FILTERING, &error) || error))
+    goto done;
+
+  threshold = 0;
+  if (g_key_file_has_key (key_file, CONFIG_GROUP_PROPERTY, CONFIG_PROPERTY_SEG_MIOU_THRESHOLD, NULL))
+  {
+    threshold = g_key_file_get_double (key_file, CONFIG_GROUP_PROPERTY, CONFIG_PROPERTY_SEG_MIOU_THRESHOLD, &error);
+    CHECK_ERROR (error);
+  }
+
+done:
+  if (key_file) {
+    g_key_file_free (key_file);
+  }
+
+  if (error) {
+    g_error_free (error);
+  }
+
+  return threshold;
+}
+
+/* Returns the classes-to-filter labels, NULL if missing */
+gchar **get_classes_to_filter_from_cfg_file(const gchar *cfg_file_path)
+{
+  GKeyFile *key_file = g_key_file_new ();
+  GError *error = NULL;
+  gchar **classes = NULL;
+
+  if (!g_key_file_load_from_file (key_file, cfg_file_path, G_KEY_FILE_NONE, &error))
+  {
+    g_printerr ("Failed to load config file: %s\n", error->message);
+    goto done;
+  }
+
+  if (!g_key_file_has_group (key_file, CONFIG_GROUP_PROPERTY))
+  {
+    g_printerr ("Could not find group %s\n", CONFIG_GROUP_PROPERTY);
+    goto done;
+  }
+
+  if (g_key_file_has_key (key_file, CONFIG_GROUP_PROPERTY, CONFIG_PROPERTY_CLASSES_TO_FILTER, NULL))
+  {
+    classes = g_key_file_get_string_list (key_file, CONFIG_GROUP_PROPERTY, CONFIG_PROPERTY_CLASSES_TO_FILTER, NULL, &error);
+    CHECK_ERROR (error);
+    for (gchar **label = classes; *label; label++)
+      g_strstrip (*label);
+  }
+
+done:
+  if (key_file) {
+    g_key_file_free (key_file);
+  }
+
+  if (error) {
+    g_error_free (error);
+  }
+
+  return classes;
+}
 
 int
 main (int argc, char *argv[])
 {
   GMainLoop *loop = NULL;
-  GstElement *pipeline = NULL, *source = NULL, *streammux = NULL, *primary_detector = NULL,
-    *nvvidconv1 = NULL, *nvvidconv2 = NULL, *nvosd = NULL, *sink = NULL, *nvvidconv3 = NULL;
+  GstElement *pipeline = NULL, *streammux = NULL, *primary_detector = NULL,
+    *nvvidconv1 = NULL, *nvvidconv2 = NULL, *nvosd = NULL, *sink = NULL, *nvvidconv3 = NULL, *tiler = NULL;
+  /* Element whose sink pad receives batches after fpfilter */
+  GstElement *after_filter_element = NULL;
 
   GstBus *bus = NULL;
   guint bus_watch_id;
+  GError *error = NULL;
 
-  /* Check input arguments */
-  if (argc < 4) {
-    g_printerr ("Usage: %s <location_of_input> <location_to_save_kitti_labels> <location_to_save_output_video>\n", argv[0]);
+  GOptionContext *option_ctx = g_option_context_new (
+      "<location_of_input> [<location_of_input> ...] <location_to_save_kitti_labels> [<location_to_save_output_video>]");
+  g_option_context_add_main_entries (option_ctx, option_entries, NULL);
+  g_option_context_add_group (option_ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (option_ctx, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    g_option_context_free (option_ctx);
+    return -1;
+  }
+  g_option_context_free (option_ctx);
+
+  /* The sinks of this app do not sync to the clock, so they send no QoS events */
+  if (load_shedding && (shed_budget_ms <= 0)) {
+    g_printerr ("--load-shedding needs --shed-budget-ms\n");
     return -1;
   }
 
+  AsyncLogLevel log_level = log_level_name ? async_log_level_from_name (log_level_name) : ASYNC_LOG_INFO;
+  if (log_level == ASYNC_LOG_MAX) {
+    g_printerr ("Unknown log level %s\n", log_level_name);
+    return -1;
+  }
+  async_log_init (log_level);
+  /* Early returns below still flush pending records and join the log thread */
+  atexit (async_log_stop);
+
+  /* Mining writes verdicts only, the single argument is its output directory */
+  if (mine_input)
+  {
+    if (argc != 2) {
+      g_printerr ("Usage: %s --mine=PATH [--mine-parallel=N] <location_to_save_verdicts>\n", argv[0]);
+      return -1;
+    }
+    metadata_only = TRUE;
+  }
+
+  if (!g_strcmp0 (sink_type, SINK_TYPE_NONE))
+    metadata_only = TRUE;
+  if (metadata_only)
+    sink_type = SINK_TYPE_NONE;
+
+  /* Check input arguments. Output video location is needed only for the file sink. */
+  clip_recording = !g_strcmp0 (sink_type, SINK_TYPE_CLIPS);
+  guint num_outputs = (g_strcmp0 (sink_type, SINK_TYPE_FILE) && !clip_recording) ? 1 : 2;
+  gchar *kitti_output_arg = NULL;
+  gchar *video_output_arg = NULL;
+  if (mine_input)
+  {
+    if (!dataset_miner_init (mine_input, argv[1]))
+      return -1;
+    num_sources = MIN ((guint) CLAMP (mine_parallel, 1, MAX_NUM_SOURCES), dataset_miner_get_pending ());
+    if (num_sources == 0) {
+      g_print ("Nothing left to mine\n");
+      dataset_miner_close ();
+      return 0;
+    }
+  }
+  else
+  {
+    if (argc < (gint) num_outputs + 2) {
+      g_printerr ("Usage: %s [-m] [--sink=TYPE] <location_of_input> [<location_of_input> ...] <location_to_save_kitti_labels> %s\n",
+          argv[0], (num_outputs == 1) ? "" : clip_recording ? "<directory_to_save_clips>" : "<location_to_save_output_video>");
+      return -1;
+    }
+
+    /* All but the output arguments are inputs */
+    num_sources = argc - 1 - num_outputs;
+    if (num_sources > MAX_NUM_SOURCES) {
+      g_printerr ("At most %d inputs are supported\n", MAX_NUM_SOURCES);
+      return -1;
+    }
+    kitti_output_arg = argv[num_sources + 1];
+    video_output_arg = (num_outputs == 1) ? NULL : argv[num_sources + 2];
+  }
+  source_slots = MIN (MAX (num_sources, (guint) MAX (max_sources, 0)), MAX_NUM_SOURCES);
+  free_source_slots = source_slots - num_sources;
+  if (clip_recording)
+  {
+    g_mkdir_with_parents (video_output_arg, 0755);
+    clip_recorder_init (video_output_arg, clip_pre_s, clip_post_s);
+  }
+
   int current_device = -1;
   cudaGetDevice(&current_device);
   struct cudaDeviceProp prop;
   cudaGetDeviceProperties(&prop, current_device);
 
+  init_stage_stats();
+  fpfilter_assessed_objects = g_array_new (FALSE, FALSE, sizeof (AssessedObject));
+  fp_cache_init (fp_cache_cell_px, fp_cache_revalidate_frames, 2 * fp_cache_revalidate_frames);
+  /* Confirmed tracks are assessed again after a while, they may turn into true positives */
+  fp_feedback_init (fp_feedback_frames, 15 * fp_feedback_frames);
+  fp_stats_init (fp_stats_window_s);
+  load_shedder_init (SHED_LEVEL_MAX, shed_budget_ms, apply_shed_level);
+  batch_controller_init (MAX (0, batch_timeout_min_ms) * 1000, MAX (0, batch_timeout_max_ms) * 1000);
+  if (prefilter_config_file && !prefilter_init (prefilter_config_file))
+  {
+    g_printerr ("Failed to load pre-filter config %s\n", prefilter_config_file);
+    return -1;
+  }
+  latency_tracer_init();
   pgie_unique_id = get_pgie_id_from_cfg_file(FPFILTER_CONFIG_FILE);
+  if (mask_prescore)
+  {
+    seg_miou_threshold = get_seg_miou_threshold_from_cfg_file(FPFILTER_CONFIG_FILE);
+    prescore_classes = get_classes_to_filter_from_cfg_file(FPFILTER_CONFIG_FILE);
+    /* Additional assessors may support boxes the segmentation check fails */
+    if ((seg_miou_threshold <= 0) || extra_assessor_configs || !prescore_classes)
+    {
+      g_print ("mask prescore needs the segmentation assessor alone without tracker filtering, "
+          "a seg-miou-threshold and classes-to-filter, disabled\n");
+      mask_prescore = FALSE;
+    }
+  }
+  init_object_pass_features();
   g_print("pgie unique id: %d\n", pgie_unique_id);
 
   /* Standard GStreamer initialization */
@@ -1091,10 +3144,8 @@ main (int argc, char *argv[])
   /* Create Pipeline element that will form a connection of other elements */
   pipeline = gst_pipeline_new ("pipeline");
 
-  snprintf(output_path, 1024, "%s", argv[2]);
-
-  strcpy(source_info, argv[1]);
-  source = create_source_bin("source_bin", argv[1]);
+  if (kitti_output_arg)
+    snprintf(output_path, 1024, "%s", kitti_output_arg);
 
   /* Create nvstreammux instance to form batches from one or more sources. */
   streammux = gst_element_factory_make ("nvstreammux", "stream-muxer");
@@ -1105,41 +3156,69 @@ main (int argc, char *argv[])
   }
 
   primary_detector = gst_element_factory_make ("nvinfer", "primary-nvinference-engine1");
+  if (!primary_detector) {
+    g_printerr ("One element could not be created. Exiting.\n");
+    return -1;
+  }
 
-  /* Use convertor to convert from NV12 to RGBA as required by nvosd */
-  nvvidconv1 = gst_element_factory_make ("nvvideoconvert", "nvvideo-converter1");
+  if (!metadata_only) {
+    /* Use convertor to convert from NV12 to RGBA as required by nvosd */
+    nvvidconv1 = gst_element_factory_make ("nvvideoconvert", "nvvideo-converter1");
 
-  nvvidconv2 = gst_element_factory_make ("nvvideoconvert", "nvvideo-converter2");
+    nvvidconv2 = gst_element_factory_make ("nvvideoconvert", "nvvideo-converter2");
 
-  nvvidconv3 = gst_element_factory_make ("nvvideoconvert", "nvvideo-converter3");
+    nvvidconv3 = gst_element_factory_make ("nvvideoconvert", "nvvideo-converter3");
 
-  /* Create OSD to draw on the converted RGBA buffer */
-  nvosd = gst_element_factory_make ("nvdsosd", "nv-onscreendisplay");
+    /* Create OSD to draw on the converted RGBA buffer */
+    nvosd = gst_element_factory_make ("nvdsosd", "nv-onscreendisplay");
 
-  if (!source || !primary_detector || !nvvidconv1 || !nvvidconv2 || !nvvidconv3 || !nvosd) {
-    g_printerr ("One element could not be created. Exiting.\n");
-    return -1;
+    if (!nvvidconv1 || !nvvidconv2 || !nvvidconv3 || !nvosd) {
+      g_printerr ("One element could not be created. Exiting.\n");
+      return -1;
+    }
+
+    g_object_set (G_OBJECT (nvosd), "display-mask", 1, NULL);
+    g_object_set (G_OBJECT (nvosd), "display-bbox", 1, NULL);
+    g_object_set (G_OBJECT (nvosd), "process-mode", 0, NULL);
+  }
+
+  /* Composite the batch into a single frame for OSD and output */
+  if (!metadata_only && (source_slots > 1)) {
+    tiler = gst_element_factory_make ("nvmultistreamtiler", "nvtiler");
+    if (!tiler) {
+      g_printerr ("One element could not be created. Exiting.\n");
+      return -1;
+    }
+    guint tiler_rows = (guint) sqrt (source_slots);
+    guint tiler_columns = (guint) ceil (1.0 * source_slots / tiler_rows);
+    g_object_set (G_OBJECT (tiler), "rows", tiler_rows, "columns", tiler_columns,
+        "width", MUXER_OUTPUT_WIDTH, "height", MUXER_OUTPUT_HEIGHT, NULL);
   }
 
   g_object_set (G_OBJECT (streammux), "width", MUXER_OUTPUT_WIDTH, "height",
-      MUXER_OUTPUT_HEIGHT, "batch-size", 1,
+      MUXER_OUTPUT_HEIGHT, "batch-size", source_slots,
       "batched-push-timeout", MUXER_BATCH_TIMEOUT_USEC, NULL);
 
-  g_object_set (G_OBJECT (primary_detector), "config-file-path", INFER_PEOPLENET_CONFIG_FILE, NULL);
-
-  g_object_set (G_OBJECT (nvosd), "display-mask", 1, NULL);
-  g_object_set (G_OBJECT (nvosd), "display-bbox", 1, NULL);
-  g_object_set (G_OBJECT (nvosd), "process-mode", 0, NULL);
+  g_object_set (G_OBJECT (primary_detector), "config-file-path", INFER_PEOPLENET_CONFIG_FILE,
+      "batch-size", source_slots, NULL);
 
   /* we add a message handler */
   bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
   bus_watch_id = gst_bus_add_watch (bus, bus_call, loop);
   gst_object_unref (bus);
 
-  sink = create_sink_bin ("sink_bin", argv[3]);
+  sink = create_sink_bin ("sink_bin", video_output_arg);
+  if (!sink) {
+    g_printerr ("One element could not be created. Exiting.\n");
+    return -1;
+  }
+
+  if (!create_stage_queues ())
+    return -1;
 
   is_fpfilter_enabled = get_fpfilter_status_from_cfg_file(FPFILTER_CONFIG_FILE);
-  if (is_fpfilter_enabled)
+  /* With warm bypass the bin is always part of the pipeline, disabled state is a bypass */
+  if (is_fpfilter_enabled || warm_bypass)
   {
     fpfilter_bin = create_filter_elements_bin("fp-filter-bin");
     if (!fpfilter_bin)
@@ -1148,85 +3227,191 @@ main (int argc, char *argv[])
       return -1;
     }
   }
+  if (warm_bypass)
+    set_fpfilter_bypass(!is_fpfilter_enabled);
+
+  /* Element chain in front of fp-filter-bin, the last two are its dynamic link neighbours */
+  GstElement *pre_filter_chain[5] = {NULL,};
+  guint pre_filter_len = 0;
+  pre_filter_chain[pre_filter_len++] = streammux;
+  pre_filter_chain[pre_filter_len++] = primary_detector;
+  if (stage_queues[QUEUE_AFTER_PRIMARY])
+    pre_filter_chain[pre_filter_len++] = stage_queues[QUEUE_AFTER_PRIMARY];
+  if (!metadata_only)
+    pre_filter_chain[pre_filter_len++] = nvvidconv1;
+  if (stage_queues[QUEUE_PRE_FILTER])
+    pre_filter_chain[pre_filter_len++] = stage_queues[QUEUE_PRE_FILTER];
+
+  after_filter_element = metadata_only ? sink : nvvidconv2;
+  if (stage_queues[QUEUE_POST_FILTER])
+    after_filter_element = stage_queues[QUEUE_POST_FILTER];
 
   fp_filter_dynamic_link_info.main_element = fpfilter_bin;
-  fp_filter_dynamic_link_info.main_prev_element = nvvidconv1;
-  fp_filter_dynamic_link_info.main_prev_prev_element = primary_detector;
-  fp_filter_dynamic_link_info.main_next_element = nvvidconv2;
+  fp_filter_dynamic_link_info.main_prev_element = pre_filter_chain[pre_filter_len - 1];
+  /* A queue keeps pushing from its own thread while upstream is blocked, so a
+   * queue in front of the bin is blocked itself */
+  fp_filter_dynamic_link_info.main_prev_prev_element = pre_filter_chain[pre_filter_len - 2];
+  for (guint idx = 0; idx < QUEUE_MAX; idx++)
+  {
+    if (stage_queues[idx] && (stage_queues[idx] == fp_filter_dynamic_link_info.main_prev_element))
+      fp_filter_dynamic_link_info.main_prev_prev_element = NULL;
+  }
+  fp_filter_dynamic_link_info.main_next_element = after_filter_element;
   fp_filter_dynamic_link_info.pipeline = pipeline;
   fp_filter_dynamic_link_info.loop = loop;
+  if (!warm_bypass)
+    fp_filter_dynamic_link_info.failed_cb = fpfilter_toggle_failed;
 
   g_mutex_init (&fpfilter_images_save_mutex);
+  g_mutex_init (&fpfilter_toggle_mutex);
+  g_mutex_init (&fpfilter_stream_mask_mutex);
 
-  gst_bin_add_many (GST_BIN (pipeline), source, streammux, primary_detector, nvosd, nvvidconv1, nvvidconv2, nvvidconv3, sink, NULL);
-  if (is_fpfilter_enabled)
+  gst_bin_add_many (GST_BIN (pipeline), streammux, primary_detector, sink, NULL);
+  if (!metadata_only)
+    gst_bin_add_many (GST_BIN (pipeline), nvosd, nvvidconv1, nvvidconv2, nvvidconv3, NULL);
+  if (fpfilter_bin)
     gst_bin_add(GST_BIN (pipeline), fpfilter_bin);
+  if (tiler)
+    gst_bin_add(GST_BIN (pipeline), tiler);
+  for (guint idx = 0; idx < QUEUE_MAX; idx++)
+  {
+    if (stage_queues[idx])
+      gst_bin_add(GST_BIN (pipeline), stage_queues[idx]);
+  }
 
-  GstPad *sinkpad = NULL, *srcpad = NULL;
-
-  sinkpad = gst_element_get_request_pad (streammux, "sink_0");
-  if (!sinkpad) {
-    g_printerr ("Streammux request sink pad failed. Exiting.\n");
-    return -1;
+  app_pipeline = pipeline;
+  app_streammux = streammux;
+  for (guint idx = 0; idx < num_sources; idx++)
+  {
+    if (!add_source(pipeline, streammux, idx, mine_input ? dataset_miner_start_slot (idx) : argv[idx + 1]))
+      return -1;
   }
 
-  srcpad = gst_element_get_static_pad (source, "src");
-  if (!srcpad) {
-    g_printerr ("Decoder request src pad failed. Exiting.\n");
-    gst_object_unref (sinkpad);
-    return -1;
+  for (guint idx = 1; idx < pre_filter_len; idx++)
+  {
+    if (!gst_element_link (pre_filter_chain[idx - 1], pre_filter_chain[idx])) {
+      g_printerr ("Elements could not be linked: 2. Exiting.\n");
+      return -1;
+    }
   }
 
-  if (gst_pad_link (srcpad, sinkpad) != GST_PAD_LINK_OK) {
-    g_printerr ("Failed to link decoder to stream muxer. Exiting.\n");
-    gst_object_unref (sinkpad);
-    gst_object_unref (srcpad);
+  if (stage_queues[QUEUE_POST_FILTER] &&
+      !gst_element_link (stage_queues[QUEUE_POST_FILTER], metadata_only ? sink : nvvidconv2)) {
+    g_printerr ("Elements could not be linked: 2. Exiting.\n");
     return -1;
   }
 
-  gst_object_unref (sinkpad);
-  gst_object_unref (srcpad);
+  /* Encoder runs on its own thread when the pre-encode queue is requested */
+  GstElement *encode_element = sink;
+  if (stage_queues[QUEUE_PRE_ENCODE])
+  {
+    if (!gst_element_link (stage_queues[QUEUE_PRE_ENCODE], sink)) {
+      g_printerr ("Elements could not be linked: 2. Exiting.\n");
+      return -1;
+    }
+    encode_element = stage_queues[QUEUE_PRE_ENCODE];
+  }
 
-  if (!is_fpfilter_enabled)
+  if (!fpfilter_bin)
   {
-    if (!gst_element_link_many (streammux, primary_detector, nvvidconv1, nvvidconv2, nvosd, nvvidconv3, sink, NULL)) {
+    if (!gst_element_link_many (fp_filter_dynamic_link_info.main_prev_element, after_filter_element, NULL)) {
       g_printerr ("Elements could not be linked: 2. Exiting.\n");
       return -1;
     }
   }
   else
   {
-    if (!gst_element_link_many (streammux, primary_detector, nvvidconv1, fpfilter_bin, nvvidconv2, nvosd, nvvidconv3, sink, NULL)) {
+    if (!gst_element_link_many (fp_filter_dynamic_link_info.main_prev_element, fpfilter_bin, after_filter_element, NULL)) {
+      g_printerr ("Elements could not be linked: 2. Exiting.\n");
+      return -1;
+    }
+  }
+
+  if (tiler)
+  {
+    if (!gst_element_link_many (nvvidconv2, tiler, nvosd, nvvidconv3, encode_element, NULL)) {
+      g_printerr ("Elements could not be linked: 2. Exiting.\n");
+      return -1;
+    }
+  }
+  else if (!metadata_only)
+  {
+    if (!gst_element_link_many (nvvidconv2, nvosd, nvvidconv3, encode_element, NULL)) {
       g_printerr ("Elements could not be linked: 2. Exiting.\n");
       return -1;
     }
   }
 
-  /* Adding probe before and after filter element to save kitti data */
-  GstPad *nvvidconv_sink_pad = gst_element_get_static_pad (nvvidconv2, "sink");
-  if (!nvvidconv_sink_pad)
+  latency_tracer_set_origin (streammux);
+  if (load_shedding)
+    load_shedder_set_origin (streammux);
+  if (adaptive_batching && !batch_controller_attach (streammux))
+    return -1;
+  latency_tracer_add_element (primary_detector, "primary_detector");
+  if (!metadata_only)
+  {
+    latency_tracer_add_element (nvvidconv1, "nvvidconv1");
+    latency_tracer_add_element (nvvidconv2, "nvvidconv2");
+    if (tiler)
+      latency_tracer_add_element (tiler, "tiler");
+    latency_tracer_add_element (nvosd, "nvosd");
+    latency_tracer_add_element (nvvidconv3, "nvvidconv3");
+  }
+  latency_tracer_set_end (sink);
+
+  /* Adding probe after filter element to save kitti data. With a post-filter
+   * queue the probe sits on its src pad so kitti writing and frame saving run
+   * on the queue thread instead of the fpfilter thread. */
+  GstPad *after_filter_sink_pad = gst_element_get_static_pad (after_filter_element,
+      stage_queues[QUEUE_POST_FILTER] ? "src" : "sink");
+  if (!after_filter_sink_pad)
   {
-    g_print ("Unable to get nvvidconv sink pad\n");
+    g_print ("Unable to get after filter sink pad\n");
     return -1;
   }
 
-  gst_pad_add_probe (nvvidconv_sink_pad, GST_PAD_PROBE_TYPE_BUFFER, after_filter_buffer_probe, NULL, NULL);
-  gst_object_unref (nvvidconv_sink_pad);
+  gst_pad_add_probe (after_filter_sink_pad, GST_PAD_PROBE_TYPE_BUFFER, after_filter_buffer_probe, NULL, NULL);
+  if (mine_input)
+  {
+    gst_pad_add_probe (after_filter_sink_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, mine_stream_eos_probe, NULL, NULL);
+    GstPad *streammux_src_pad = gst_element_get_static_pad (streammux, "src");
+    gst_pad_add_probe (streammux_src_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, mine_eos_drop_probe, NULL, NULL);
+    gst_object_unref (streammux_src_pad);
+  }
+  gst_object_unref (after_filter_sink_pad);
+
+  GstPad *muxed_pad = gst_element_get_static_pad (streammux, "src");
+  gst_pad_add_probe (muxed_pad, GST_PAD_PROBE_TYPE_BUFFER, count_muxed_frames_probe, NULL, NULL);
+  gst_object_unref (muxed_pad);
 
   frame_save_queue = g_async_queue_new ();
   start_save_frame_task(frame_save_queue);
   /* Set the pipeline to "playing" state */
-  g_print ("Now playing: %s\n", argv[1]);
+  for (guint idx = 0; idx < num_sources; idx++)
+    g_print ("Now playing: %s\n", source_infos[idx].location);
   gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  gint64 start_time_us = g_get_monotonic_time ();
   start_usr_prompt_monitor(handle_usr_prompt);
+  start_metrics_server(write_metrics);
+  if (bench_mode)
+    g_timeout_add_seconds (1, print_bench_stats, NULL);
+  if (fp_stats_interval_s > 0)
+    g_timeout_add_seconds (fp_stats_interval_s, post_fp_stats, pipeline);
 
   /* Wait till pipeline encounters an error or EOS */
   g_print ("Running...\n");
   g_main_loop_run (loop);
+  gdouble run_time_s = (g_get_monotonic_time () - start_time_us) / 1000000.0;
 
   /* Out of the main loop, clean up nicely */
   stop_usr_prompt_monitor();
+  stop_metrics_server();
   stop_save_frame_task();
+  if (clip_recording)
+  {
+    clip_recorder_stop ();
+    g_print("clips recorded: %u\n", clip_recorder_get_clips ());
+  }
   g_async_queue_unref(frame_save_queue);
   g_print ("Returned, stopping playback\n");
   gst_element_set_state (pipeline, GST_STATE_NULL);
@@ -1234,8 +3419,38 @@ main (int argc, char *argv[])
   gst_object_unref (GST_OBJECT (pipeline));
   g_source_remove (bus_watch_id);
   g_main_loop_unref (loop);
+  async_log_stop ();
 
   g_print("saved images cnt: %d\n", fpfilter_image_cnt);
+
+  guint total_frames = g_atomic_int_get (&retired_frames);
+  for (guint idx = 0; idx < MAX_NUM_SOURCES; idx++)
+    total_frames += g_atomic_int_get (&stream_metrics[idx].frames);
+  g_print("sources: %u frames: %u aggregate fps: %.2f\n", num_sources, total_frames,
+      run_time_s > 0 ? total_frames / run_time_s : 0);
+  print_stage_stats();
+  if (prefilter_config_file)
+    prefilter_print();
+  if (mask_prescore)
+    g_print("mask prescore: boxes: %d rejected: %d refined at full resolution: %d\n",
+        g_atomic_int_get (&prescore_boxes), g_atomic_int_get (&prescore_rejected), g_atomic_int_get (&prescore_refined));
+  if (fp_feedback_enabled)
+    g_print("fp feedback: confirmed tracks: %u dropped before tracker: %u after tracker: %u\n",
+        fp_feedback_get_confirmed (), fp_feedback_get_dropped (TRUE), fp_feedback_get_dropped (FALSE));
+  if (mine_input)
+  {
+    dataset_miner_print ();
+    dataset_miner_close ();
+  }
+  if (adaptive_batching)
+  {
+    BatchControllerState state;
+    batch_controller_get_state (&state);
+    g_print("adaptive batching: timeout: %u us fill: %.2f adjustments up: %u down: %u\n",
+        state.timeout_us, state.fill, state.increases, state.decreases);
+  }
+  if (latency_tracer_is_enabled())
+    latency_tracer_print();
   return 0;
 }
 
@@ -0,0 +1,164 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   Logging for streaming thread probes. Callers only copy a binary record into
+ *          a lock-free ring, a background thread formats and writes the records, so
+ *          formatting and write syscalls stay off the streaming threads. A full ring
+ *          drops records instead of blocking the caller.
+ * 
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ds_async_log.h"
+
+/* Idle time of the log thread between drains */
+#define ASYNC_LOG_DRAIN_INTERVAL_US     10000
+
+typedef struct {
+    guint sequence;
+    AsyncLogLevel level;
+    const gchar *fmt;
+    guint num_args;
+    gint64 args[ASYNC_LOG_MAX_ARGS];
+} AsyncLogRecord;
+
+static const gchar *g_level_names[ASYNC_LOG_MAX] = { "error", "warning", "info", "debug", "frame" };
+
+gint async_log_level = ASYNC_LOG_INFO;
+
+/* Bounded multi producer ring, every slot carries a sequence number telling whether
+ * it is free for the producer at a position or filled for the consumer. Positions
+ * are unsigned and compared by their signed difference, so they may wrap. */
+static AsyncLogRecord g_ring[ASYNC_LOG_RING_SIZE];
+static guint g_tail = 0;
+static guint g_head = 0;
+static gint g_dropped = 0;
+static gint g_stop = FALSE;
+static GThread *g_log_thread = NULL;
+
+void async_log_push(AsyncLogLevel level, const gchar *fmt, const gint64 *args, guint num_args)
+{
+    guint pos = g_atomic_int_get(&g_tail);
+    AsyncLogRecord *record = NULL;
+
+    while (TRUE)
+    {
+        record = &g_ring[pos & (ASYNC_LOG_RING_SIZE - 1)];
+        gint diff = (gint) (g_atomic_int_get(&record->sequence) - pos);
+        if (diff == 0)
+        {
+            if (g_atomic_int_compare_and_exchange(&g_tail, pos, pos + 1))
+                break;
+            pos = g_atomic_int_get(&g_tail);
+        }
+        else if (diff < 0)
+        {
+            g_atomic_int_inc(&g_dropped);
+            return;
+        }
+        else
+        {
+            pos = g_atomic_int_get(&g_tail);
+        }
+    }
+
+    record->level = level;
+    record->fmt = fmt;
+    record->num_args = MIN(num_args, ASYNC_LOG_MAX_ARGS);
+    memcpy(record->args, args, record->num_args * sizeof(gint64));
+    g_atomic_int_set(&record->sequence, pos + 1);
+}
+
+/* Formats and writes all filled records, returns the number written */
+static guint _drain(void)
+{
+    guint written = 0;
+    gchar line[512];
+
+    while (TRUE)
+    {
+        AsyncLogRecord *record = &g_ring[g_head & (ASYNC_LOG_RING_SIZE - 1)];
+        if (g_atomic_int_get(&record->sequence) != g_head + 1)
+            break;
+
+        gint64 *a = record->args;
+        g_snprintf(line, sizeof(line), record->fmt, a[0], a[1], a[2], a[3]);
+        fputs(line, stdout);
+        g_atomic_int_set(&record->sequence, g_head + ASYNC_LOG_RING_SIZE);
+        g_head++;
+        written++;
+    }
+    if (written)
+        fflush(stdout);
+    return written;
+}
+
+static gpointer _log_task(gpointer data)
+{
+    while (!g_atomic_int_get(&g_stop))
+    {
+        if (!_drain())
+            g_usleep(ASYNC_LOG_DRAIN_INTERVAL_US);
+    }
+    _drain();
+    return NULL;
+}
+
+void async_log_init(AsyncLogLevel level)
+{
+    async_log_level = level;
+    for (guint idx = 0; idx < ASYNC_LOG_RING_SIZE; idx++)
+        g_ring[idx].sequence = idx;
+    g_atomic_int_set(&g_stop, FALSE);
+    g_log_thread = g_thread_new("DS app log thread", _log_task, NULL);
+}
+
+void async_log_stop(void)
+{
+    if (!g_log_thread)
+        return;
+
+    g_atomic_int_set(&g_stop, TRUE);
+    g_thread_join(g_log_thread);
+    g_log_thread = NULL;
+    if (g_atomic_int_get(&g_dropped))
+        g_print("log records dropped: %d\n", g_atomic_int_get(&g_dropped));
+}
+
+AsyncLogLevel async_log_level_from_name(const gchar *name)
+{
+    for (guint idx = 0; idx < ASYNC_LOG_MAX; idx++)
+    {
+        if (!g_strcmp0(name, g_level_names[idx]))
+            return idx;
+    }
+    return ASYNC_LOG_MAX;
+}
+
+guint async_log_get_dropped(void)
+{
+    return g_atomic_int_get(&g_dropped);
+}
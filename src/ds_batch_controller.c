@@ -0,0 +1,174 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   Adjusts the streammux batched-push-timeout to the sources. The target wait
+ *          is one frame interval of the slowest active stream, so each stream can put
+ *          a frame into every batch. The wait is raised to it only while batches leave
+ *          streammux underfilled and lowered towards it in halves, so a short dip in
+ *          arrival rate does not pull the latency bound down at once.
+ * 
+ */
+
+#include "ds_batch_controller.h"
+#include "gstnvdsmeta.h"
+
+static GMutex g_controller_mutex;
+static GstElement *g_streammux = NULL;
+static guint g_min_timeout_us = 0;
+static guint g_max_timeout_us = G_MAXUINT;
+static guint g_batch_size = 1;
+
+/* Counts of the current interval */
+static guint g_batches = 0;
+static guint g_frames = 0;
+static guint g_stream_frames[BATCH_CONTROLLER_MAX_STREAMS];
+static gint64 g_interval_start_us = 0;
+
+static BatchControllerState g_state;
+static gdouble g_stream_fps[BATCH_CONTROLLER_MAX_STREAMS];
+
+void batch_controller_init(guint min_timeout_us, guint max_timeout_us)
+{
+    g_mutex_init(&g_controller_mutex);
+    g_min_timeout_us = min_timeout_us;
+    g_max_timeout_us = MAX(min_timeout_us, max_timeout_us);
+}
+
+static GstPadProbeReturn
+_batch_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(GST_PAD_PROBE_INFO_BUFFER(info));
+    if (!batch_meta)
+        return GST_PAD_PROBE_OK;
+
+    g_mutex_lock(&g_controller_mutex);
+    g_batches++;
+    for (NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next)
+    {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        g_frames++;
+        if (frame_meta->pad_index < BATCH_CONTROLLER_MAX_STREAMS)
+            g_stream_frames[frame_meta->pad_index]++;
+    }
+    g_mutex_unlock(&g_controller_mutex);
+    return GST_PAD_PROBE_OK;
+}
+
+static gboolean _adjust(gpointer user_data)
+{
+    gint64 now_us = g_get_monotonic_time();
+
+    g_mutex_lock(&g_controller_mutex);
+    gdouble elapsed_s = (now_us - g_interval_start_us) / 1000000.0;
+    guint batches = g_batches;
+    guint frames = g_frames;
+    gdouble min_fps = 0;
+    guint active_streams = 0;
+    for (guint idx = 0; idx < BATCH_CONTROLLER_MAX_STREAMS; idx++)
+    {
+        g_stream_fps[idx] = (elapsed_s > 0) ? g_stream_frames[idx] / elapsed_s : 0;
+        if (g_stream_frames[idx])
+        {
+            min_fps = active_streams ? MIN(min_fps, g_stream_fps[idx]) : g_stream_fps[idx];
+            active_streams++;
+        }
+        g_stream_frames[idx] = 0;
+    }
+    g_batches = 0;
+    g_frames = 0;
+    g_interval_start_us = now_us;
+
+    /* Paused or between sources, keep the timeout */
+    if (!batches || (min_fps <= 0))
+    {
+        g_mutex_unlock(&g_controller_mutex);
+        return TRUE;
+    }
+
+    gdouble fill = (gdouble) frames / ((gdouble) batches * g_batch_size);
+    guint target_us = (guint) CLAMP(BATCH_CONTROLLER_MARGIN * 1000000.0 / min_fps, g_min_timeout_us, g_max_timeout_us);
+    guint timeout_us = g_state.timeout_us;
+    if ((target_us > timeout_us) && (fill < BATCH_CONTROLLER_FULL_FILL))
+    {
+        timeout_us = target_us;
+        g_state.increases++;
+    }
+    else if (target_us < timeout_us)
+    {
+        timeout_us -= (timeout_us - target_us + 1) / 2;
+        g_state.decreases++;
+    }
+    gboolean changed = (timeout_us != g_state.timeout_us);
+    g_state.timeout_us = timeout_us;
+    g_state.fill = fill;
+    g_state.min_fps = min_fps;
+    g_state.active_streams = active_streams;
+    g_mutex_unlock(&g_controller_mutex);
+
+    if (changed)
+        g_object_set(G_OBJECT(g_streammux), "batched-push-timeout", timeout_us, NULL);
+    return TRUE;
+}
+
+gboolean batch_controller_attach(GstElement *streammux)
+{
+    GstPad *pad = gst_element_get_static_pad(streammux, "src");
+    if (!pad)
+    {
+        g_print("batch controller: src pad not found\n");
+        return FALSE;
+    }
+
+    gint timeout_us = 0;
+    g_object_get(G_OBJECT(streammux), "batch-size", &g_batch_size, "batched-push-timeout", &timeout_us, NULL);
+    g_batch_size = MAX(1, g_batch_size);
+    g_streammux = streammux;
+    g_state.timeout_us = CLAMP((guint) MAX(0, timeout_us), g_min_timeout_us, g_max_timeout_us);
+    g_object_set(G_OBJECT(streammux), "batched-push-timeout", g_state.timeout_us, NULL);
+    g_interval_start_us = g_get_monotonic_time();
+
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, _batch_probe, NULL, NULL);
+    gst_object_unref(pad);
+    g_timeout_add(BATCH_CONTROLLER_INTERVAL_MS, _adjust, NULL);
+    return TRUE;
+}
+
+void batch_controller_get_state(BatchControllerState *state)
+{
+    g_mutex_lock(&g_controller_mutex);
+    *state = g_state;
+    g_mutex_unlock(&g_controller_mutex);
+}
+
+gdouble batch_controller_get_stream_fps(guint stream)
+{
+    if (stream >= BATCH_CONTROLLER_MAX_STREAMS)
+        return 0;
+
+    g_mutex_lock(&g_controller_mutex);
+    gdouble fps = g_stream_fps[stream];
+    g_mutex_unlock(&g_controller_mutex);
+    return fps;
+}
@@ -0,0 +1,202 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   Joins parallel tee branches back into one stream. A tee pushes the same
+ *          batch buffer, and so the same batch metadata, to every branch. Branches
+ *          attach their metadata to it in place, so the merge only has to hold the
+ *          output batch until every branch has processed it. Batches are matched by
+ *          their count since each branch sees every batch of the tee in order. A batch
+ *          whose branches miss the timeout is dropped rather than pushed incomplete.
+ * 
+ */
+
+#include "ds_branch_merge.h"
+
+struct _BranchMerge {
+    gchar *name;
+    GMutex lock;
+    GCond cond;
+    guint num_branches;
+    guint64 *branch_cnt;
+    guint64 out_cnt;
+    guint64 dropped_cnt;
+    gboolean flushing;
+};
+
+BranchMerge *branch_merge_new(const gchar *name, guint num_branches)
+{
+    BranchMerge *merge = g_new0(BranchMerge, 1);
+    merge->name = g_strdup(name);
+    merge->num_branches = num_branches;
+    merge->branch_cnt = g_new0(guint64, num_branches);
+    g_mutex_init(&merge->lock);
+    g_cond_init(&merge->cond);
+    return merge;
+}
+
+void branch_merge_free(BranchMerge *merge)
+{
+    if (!merge)
+        return;
+    g_mutex_clear(&merge->lock);
+    g_cond_clear(&merge->cond);
+    g_free(merge->branch_cnt);
+    g_free(merge->name);
+    g_free(merge);
+}
+
+typedef struct {
+    BranchMerge *merge;
+    guint branch;
+} BranchProbeData;
+
+static GstPadProbeReturn
+_branch_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    BranchProbeData *data = (BranchProbeData *) user_data;
+    BranchMerge *merge = data->merge;
+
+    g_mutex_lock(&merge->lock);
+    merge->branch_cnt[data->branch]++;
+    g_cond_broadcast(&merge->cond);
+    g_mutex_unlock(&merge->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Returns TRUE when every branch has processed the first cnt batches */
+static gboolean _branches_done(BranchMerge *merge, guint64 cnt)
+{
+    for (guint idx = 0; idx < merge->num_branches; idx++)
+    {
+        if (merge->branch_cnt[idx] < cnt)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static GstPadProbeReturn
+_output_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    BranchMerge *merge = (BranchMerge *) user_data;
+
+    if (info->type & GST_PAD_PROBE_TYPE_EVENT_FLUSH)
+    {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        g_mutex_lock(&merge->lock);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_START)
+        {
+            merge->flushing = TRUE;
+            g_cond_broadcast(&merge->cond);
+        }
+        else if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+        {
+            /* tee flushes every branch, so all of them start counting again */
+            for (guint idx = 0; idx < merge->num_branches; idx++)
+                merge->branch_cnt[idx] = 0;
+            merge->out_cnt = 0;
+            merge->flushing = FALSE;
+        }
+        g_mutex_unlock(&merge->lock);
+        return GST_PAD_PROBE_OK;
+    }
+
+    gint64 deadline = g_get_monotonic_time() + BRANCH_MERGE_TIMEOUT_US;
+    gboolean timed_out = FALSE;
+    g_mutex_lock(&merge->lock);
+    guint64 cnt = ++merge->out_cnt;
+    while (!merge->flushing && !_branches_done(merge, cnt))
+    {
+        if (!g_cond_wait_until(&merge->cond, &merge->lock, deadline))
+        {
+            timed_out = TRUE;
+            merge->dropped_cnt++;
+            break;
+        }
+    }
+    g_mutex_unlock(&merge->lock);
+
+    /* Downstream relies on every branch result being present, a partial batch is not pushed.
+     * Branch counts keep running, so later batches still match once the branch catches up. */
+    if (timed_out)
+    {
+        GstElement *element = gst_pad_get_parent_element(pad);
+        gchar *text = g_strdup_printf("%s: branches did not finish batch %" G_GUINT64_FORMAT
+            " in time, dropped it", merge->name, cnt);
+        g_printerr("%s\n", text);
+        if (element)
+        {
+            GError *error = g_error_new_literal(GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED, text);
+            gst_element_post_message(element, gst_message_new_warning(GST_OBJECT(element), error, merge->name));
+            g_error_free(error);
+            gst_object_unref(element);
+        }
+        g_free(text);
+        return GST_PAD_PROBE_DROP;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+guint64 branch_merge_get_dropped(BranchMerge *merge)
+{
+    g_mutex_lock(&merge->lock);
+    guint64 dropped = merge->dropped_cnt;
+    g_mutex_unlock(&merge->lock);
+    return dropped;
+}
+
+gboolean branch_merge_add_branch(BranchMerge *merge, guint branch, GstElement *element)
+{
+    if (branch >= merge->num_branches)
+        return FALSE;
+
+    GstPad *src_pad = gst_element_get_static_pad(element, "src");
+    if (!src_pad)
+    {
+        g_printerr("%s: unable to get src pad of branch %u\n", merge->name, branch);
+        return FALSE;
+    }
+
+    BranchProbeData *data = g_new0(BranchProbeData, 1);
+    data->merge = merge;
+    data->branch = branch;
+    gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, _branch_probe, data, g_free);
+    gst_object_unref(src_pad);
+    return TRUE;
+}
+
+gboolean branch_merge_set_output(BranchMerge *merge, GstElement *element)
+{
+    GstPad *src_pad = gst_element_get_static_pad(element, "src");
+    if (!src_pad)
+    {
+        g_printerr("%s: unable to get output src pad\n", merge->name);
+        return FALSE;
+    }
+
+    gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+        _output_probe, merge, NULL);
+    gst_object_unref(src_pad);
+    return TRUE;
+}
@@ -0,0 +1,251 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   Records clips around events instead of encoding the whole run to one file.
+ *          Encoded frames are kept in a pre-event ring trimmed at key frames. A trigger
+ *          starts a writer pipeline (appsrc, h264parse, qtmux, filesink), which gets
+ *          the ring and then the live frames until post_s seconds after the trigger.
+ * 
+ */
+
+#include "ds_clip_recorder.h"
+
+typedef struct {
+    GstElement *pipeline;
+    GstElement *appsrc;
+    GstClockTime base_pts;
+    GstClockTime end_pts;
+} ClipWriter;
+
+static gchar *g_dir = NULL;
+static GstClockTime g_pre_ns = 0;
+static GstClockTime g_post_ns = 0;
+
+static GMutex g_recorder_mutex;
+/* Encoded frames of the last pre_s seconds, the head is always a key frame */
+static GQueue g_ring = G_QUEUE_INIT;
+static GstCaps *g_caps = NULL;
+static GstClockTime g_last_pts = GST_CLOCK_TIME_NONE;
+static gboolean g_triggered = FALSE;
+static ClipWriter *g_writer = NULL;
+static guint g_clips = 0;
+
+void clip_recorder_init(const gchar *dir, guint pre_s, guint post_s)
+{
+    g_dir = g_strdup(dir);
+    g_pre_ns = pre_s * GST_SECOND;
+    g_post_ns = post_s * GST_SECOND;
+    g_mutex_init(&g_recorder_mutex);
+}
+
+static gboolean _is_key_frame(GstBuffer *buf)
+{
+    return !GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+}
+
+/* Drops whole GOPs from the head while the next GOP still covers pre_s */
+static void _trim_ring(void)
+{
+    while (TRUE)
+    {
+        GList *next_key = NULL;
+        for (GList *l = g_ring.head ? g_ring.head->next : NULL; l != NULL; l = l->next)
+        {
+            if (_is_key_frame((GstBuffer *) l->data))
+            {
+                next_key = l;
+                break;
+            }
+        }
+        if (!next_key || (GST_BUFFER_PTS((GstBuffer *) next_key->data) + g_pre_ns > g_last_pts))
+            return;
+        while (g_ring.head != next_key)
+            gst_buffer_unref((GstBuffer *) g_queue_pop_head(&g_ring));
+    }
+}
+
+static gboolean _writer_bus_cb(GstBus *bus, GstMessage *msg, gpointer data)
+{
+    GstElement *pipeline = (GstElement *) data;
+
+    if ((GST_MESSAGE_TYPE(msg) != GST_MESSAGE_EOS) && (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_ERROR))
+        return TRUE;
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+        g_printerr("clip writer %s failed\n", GST_OBJECT_NAME(pipeline));
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return FALSE;
+}
+
+static ClipWriter *_start_writer(void)
+{
+    gchar *name = g_strdup_printf("clip-writer-%u", g_clips);
+    gchar *location = g_strdup_printf("%s/clip_%u.mp4", g_dir, g_clips);
+    ClipWriter *writer = g_new0(ClipWriter, 1);
+
+    writer->pipeline = gst_pipeline_new(name);
+    writer->appsrc = gst_element_factory_make("appsrc", NULL);
+    GstElement *parser = gst_element_factory_make("h264parse", NULL);
+    GstElement *mux = gst_element_factory_make("qtmux", NULL);
+    GstElement *sink = gst_element_factory_make("filesink", NULL);
+    if (!writer->appsrc || !parser || !mux || !sink)
+    {
+        g_printerr("Failed to create clip writer elements\n");
+        gst_object_unref(writer->pipeline);
+        g_free(writer);
+        writer = NULL;
+        goto done;
+    }
+
+    g_object_set(G_OBJECT(writer->appsrc), "caps", g_caps, "format", GST_FORMAT_TIME, NULL);
+    g_object_set(G_OBJECT(sink), "location", location, "sync", FALSE, "async", FALSE, NULL);
+    gst_bin_add_many(GST_BIN(writer->pipeline), writer->appsrc, parser, mux, sink, NULL);
+    gst_element_link_many(writer->appsrc, parser, mux, sink, NULL);
+
+    /* Removed from the main loop once the clip is finalized */
+    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(writer->pipeline));
+    gst_bus_add_watch(bus, _writer_bus_cb, writer->pipeline);
+    gst_object_unref(bus);
+    gst_element_set_state(writer->pipeline, GST_STATE_PLAYING);
+
+    writer->base_pts = GST_BUFFER_PTS((GstBuffer *) g_queue_peek_head(&g_ring));
+    g_print("recording clip %s\n", location);
+    g_clips++;
+
+done:
+    g_free(name);
+    g_free(location);
+    return writer;
+}
+
+static void _push(ClipWriter *writer, GstBuffer *buf)
+{
+    GstFlowReturn ret = GST_FLOW_OK;
+    /* Clips start at zero, the writer gets its own copy of the timestamps */
+    GstBuffer *clip_buf = gst_buffer_copy(buf);
+    GST_BUFFER_PTS(clip_buf) = GST_BUFFER_PTS(buf) - writer->base_pts;
+    if (GST_BUFFER_DTS_IS_VALID(buf))
+        GST_BUFFER_DTS(clip_buf) = GST_BUFFER_DTS(buf) > writer->base_pts ? GST_BUFFER_DTS(buf) - writer->base_pts : 0;
+    g_signal_emit_by_name(writer->appsrc, "push-buffer", clip_buf, &ret);
+    gst_buffer_unref(clip_buf);
+}
+
+static void _finish_writer(ClipWriter *writer)
+{
+    GstFlowReturn ret = GST_FLOW_OK;
+    g_signal_emit_by_name(writer->appsrc, "end-of-stream", &ret);
+    g_free(writer);
+}
+
+static GstPadProbeReturn
+_encoded_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!GST_BUFFER_PTS_IS_VALID(buf))
+        return GST_PAD_PROBE_OK;
+
+    g_mutex_lock(&g_recorder_mutex);
+    if (!g_caps)
+        g_caps = gst_pad_get_current_caps(pad);
+    g_last_pts = GST_BUFFER_PTS(buf);
+    /* The ring starts at a key frame */
+    if (!g_queue_is_empty(&g_ring) || _is_key_frame(buf))
+        g_queue_push_tail(&g_ring, gst_buffer_ref(buf));
+    _trim_ring();
+
+    if (g_triggered && !g_writer && !g_queue_is_empty(&g_ring))
+    {
+        g_writer = _start_writer();
+        for (GList *l = g_ring.head; g_writer && (l != NULL); l = l->next)
+            _push(g_writer, (GstBuffer *) l->data);
+    }
+    else if (g_writer)
+    {
+        _push(g_writer, buf);
+    }
+    if (g_triggered && g_writer)
+        g_writer->end_pts = g_last_pts + g_post_ns;
+    g_triggered = FALSE;
+
+    if (g_writer && (g_last_pts >= g_writer->end_pts))
+    {
+        _finish_writer(g_writer);
+        g_writer = NULL;
+    }
+    g_mutex_unlock(&g_recorder_mutex);
+    return GST_PAD_PROBE_OK;
+}
+
+gboolean clip_recorder_attach(GstElement *parser)
+{
+    GstPad *src_pad = gst_element_get_static_pad(parser, "src");
+    if (!src_pad)
+    {
+        g_printerr("Unable to get clip recorder src pad\n");
+        return FALSE;
+    }
+    gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, _encoded_probe, NULL, NULL);
+    gst_object_unref(src_pad);
+    return TRUE;
+}
+
+void clip_recorder_trigger(const gchar *reason)
+{
+    g_mutex_lock(&g_recorder_mutex);
+    if (!g_triggered && !g_writer)
+        g_print("clip triggered: %s\n", reason);
+    g_triggered = TRUE;
+    g_mutex_unlock(&g_recorder_mutex);
+}
+
+guint clip_recorder_get_clips(void)
+{
+    g_mutex_lock(&g_recorder_mutex);
+    guint clips = g_clips;
+    g_mutex_unlock(&g_recorder_mutex);
+    return clips;
+}
+
+void clip_recorder_stop(void)
+{
+    g_mutex_lock(&g_recorder_mutex);
+    if (g_writer)
+    {
+        /* The main loop is not running anymore, wait for the file to be finalized here */
+        GstElement *pipeline = g_writer->pipeline;
+        GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+        _finish_writer(g_writer);
+        g_writer = NULL;
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, 5 * GST_SECOND, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+        if (msg)
+            gst_message_unref(msg);
+        gst_object_unref(bus);
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+    }
+    while (!g_queue_is_empty(&g_ring))
+        gst_buffer_unref((GstBuffer *) g_queue_pop_head(&g_ring));
+    g_mutex_unlock(&g_recorder_mutex);
+}
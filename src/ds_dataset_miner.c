@@ -0,0 +1,447 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   Work list, verdict output and checkpointing of the offline mining mode. Items
+ *          run in parallel slots, one per streammux pad. Verdicts of a video are kept
+ *          until it is done and written together with its checkpoint line, so a resumed
+ *          run redoes only items which were in flight. A slot which gets an image keeps
+ *          one source and reads the following images through it, each image is one
+ *          frame and is checkpointed with its verdict. Items whose source failed or
+ *          gave no frame are checkpointed too and listed as failed.
+ * 
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ds_dataset_miner.h"
+
+typedef struct {
+    const gchar *item;
+    guint64 pts;
+} MinerImage;
+
+typedef struct {
+    const gchar *item;      /* video in the slot */
+    gboolean images;        /* slot reads images */
+    gboolean failed;        /* source failed, the slot waits for its stream EOS */
+    GQueue in_flight;       /* MinerImage pushed into the source, oldest first */
+    GString *verdicts;
+    GString *selected;
+} MinerSlot;
+
+static const gchar *g_extensions[] = { ".jpg", ".jpeg", ".mp4", ".mov", ".h264", ".264" };
+
+static GMutex g_miner_mutex;
+static GPtrArray *g_items = NULL;
+static guint g_next_item = 0;
+/* Images taken by a failed slot which were not decoded yet, handed out first */
+static GQueue g_retry = G_QUEUE_INIT;
+static MinerSlot g_slots[DATASET_MINER_MAX_SLOTS];
+static FILE *g_checkpoint = NULL;
+static FILE *g_verdicts = NULL;
+static FILE *g_selected = NULL;
+static FILE *g_failed = NULL;
+static guint g_skipped = 0;
+static guint g_done = 0;
+static guint g_failed_cnt = 0;
+static guint g_frames = 0;
+static guint g_selected_frames = 0;
+
+gboolean dataset_miner_is_image(const gchar *item)
+{
+    gchar *lower = g_ascii_strdown(item, -1);
+    gboolean ret = g_str_has_suffix(lower, ".jpg") || g_str_has_suffix(lower, ".jpeg");
+    g_free(lower);
+    return ret;
+}
+
+static gboolean _has_media_extension(const gchar *name)
+{
+    gchar *lower = g_ascii_strdown(name, -1);
+    gboolean ret = FALSE;
+    for (guint idx = 0; idx < G_N_ELEMENTS(g_extensions); idx++)
+        ret = ret || g_str_has_suffix(lower, g_extensions[idx]);
+    g_free(lower);
+    return ret;
+}
+
+static void _scan_dir(const gchar *path)
+{
+    GDir *dir = g_dir_open(path, 0, NULL);
+    if (!dir)
+        return;
+
+    const gchar *name = NULL;
+    while ((name = g_dir_read_name(dir)) != NULL)
+    {
+        gchar *child = g_build_filename(path, name, NULL);
+        if (g_file_test(child, G_FILE_TEST_IS_DIR))
+        {
+            _scan_dir(child);
+            g_free(child);
+        }
+        else if (_has_media_extension(name))
+        {
+            g_ptr_array_add(g_items, child);
+        }
+        else
+        {
+            g_free(child);
+        }
+    }
+    g_dir_close(dir);
+}
+
+static void _read_list(const gchar *path)
+{
+    gchar *contents = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, NULL))
+        return;
+
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for (guint idx = 0; lines[idx]; idx++)
+    {
+        gchar *line = g_strstrip(lines[idx]);
+        if (strlen(line) && (line[0] != '#'))
+            g_ptr_array_add(g_items, g_strdup(line));
+    }
+    g_strfreev(lines);
+    g_free(contents);
+}
+
+static gint _compare_items(gconstpointer a, gconstpointer b)
+{
+    return g_strcmp0(*(const gchar **) a, *(const gchar **) b);
+}
+
+/* Removes items listed in the checkpoint */
+static void _skip_done(const gchar *checkpoint_path)
+{
+    gchar *contents = NULL;
+    if (!g_file_get_contents(checkpoint_path, &contents, NULL, NULL))
+        return;
+
+    GHashTable *done = g_hash_table_new(g_str_hash, g_str_equal);
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for (guint idx = 0; lines[idx]; idx++)
+    {
+        if (strlen(lines[idx]))
+            g_hash_table_add(done, lines[idx]);
+    }
+
+    GPtrArray *remaining = g_ptr_array_new_with_free_func(g_free);
+    for (guint idx = 0; idx < g_items->len; idx++)
+    {
+        gchar *item = g_ptr_array_index(g_items, idx);
+        if (g_hash_table_contains(done, item))
+        {
+            g_skipped++;
+            continue;
+        }
+        g_ptr_array_add(remaining, g_strdup(item));
+    }
+    g_ptr_array_free(g_items, TRUE);
+    g_items = remaining;
+
+    g_hash_table_destroy(done);
+    g_strfreev(lines);
+    g_free(contents);
+}
+
+static FILE *_open_output(const gchar *output_dir, const gchar *name)
+{
+    gchar *path = g_build_filename(output_dir, name, NULL);
+    FILE *file = fopen(path, "a");
+    if (!file)
+        g_printerr("Failed to open %s\n", path);
+    g_free(path);
+    return file;
+}
+
+gboolean dataset_miner_init(const gchar *input, const gchar *output_dir)
+{
+    g_mutex_init(&g_miner_mutex);
+    g_items = g_ptr_array_new_with_free_func(g_free);
+    if (g_file_test(input, G_FILE_TEST_IS_DIR))
+        _scan_dir(input);
+    else
+        _read_list(input);
+    /* Directory order is arbitrary, resumed runs need the same order */
+    g_ptr_array_sort(g_items, _compare_items);
+
+    g_mkdir_with_parents(output_dir, 0755);
+    gchar *checkpoint_path = g_build_filename(output_dir, DATASET_MINER_CHECKPOINT_FILE, NULL);
+    _skip_done(checkpoint_path);
+    g_free(checkpoint_path);
+
+    g_checkpoint = _open_output(output_dir, DATASET_MINER_CHECKPOINT_FILE);
+    g_verdicts = _open_output(output_dir, DATASET_MINER_VERDICTS_FILE);
+    g_selected = _open_output(output_dir, DATASET_MINER_SELECTED_FILE);
+    g_failed = _open_output(output_dir, DATASET_MINER_FAILED_FILE);
+    if (!g_checkpoint || !g_verdicts || !g_selected || !g_failed)
+        return FALSE;
+
+    g_print("mining: %u items, %u already done\n", g_items->len + g_skipped, g_skipped);
+    return TRUE;
+}
+
+/* Called with the mutex held */
+static const gchar *_peek_item(void)
+{
+    if (!g_queue_is_empty(&g_retry))
+        return g_queue_peek_head(&g_retry);
+    return (g_next_item < g_items->len) ? g_ptr_array_index(g_items, g_next_item) : NULL;
+}
+
+/* Called with the mutex held */
+static void _take_item(void)
+{
+    if (!g_queue_is_empty(&g_retry))
+        g_queue_pop_head(&g_retry);
+    else
+        g_next_item++;
+}
+
+/* Called with the mutex held. The checkpoint keeps a failed item from being retried. */
+static void _fail_item(const gchar *item)
+{
+    g_printerr("mining: failed: %s\n", item);
+    fprintf(g_failed, "%s\n", item);
+    fflush(g_failed);
+    fprintf(g_checkpoint, "%s\n", item);
+    fflush(g_checkpoint);
+    g_failed_cnt++;
+}
+
+/* Called with the mutex held */
+static void _push_image(MinerSlot *miner_slot, const gchar *item, guint64 pts)
+{
+    MinerImage *image = g_new(MinerImage, 1);
+    image->item = item;
+    image->pts = pts;
+    g_queue_push_tail(&miner_slot->in_flight, image);
+}
+
+const gchar *dataset_miner_start_slot(guint slot)
+{
+    const gchar *item = NULL;
+    if (slot >= DATASET_MINER_MAX_SLOTS)
+        return NULL;
+
+    g_mutex_lock(&g_miner_mutex);
+    item = _peek_item();
+    if (item)
+    {
+        MinerSlot *miner_slot = &g_slots[slot];
+        _take_item();
+        miner_slot->failed = FALSE;
+        miner_slot->images = dataset_miner_is_image(item);
+        if (miner_slot->images)
+        {
+            _push_image(miner_slot, item, 0);
+        }
+        else
+        {
+            miner_slot->item = item;
+            if (!miner_slot->verdicts)
+            {
+                miner_slot->verdicts = g_string_new(NULL);
+                miner_slot->selected = g_string_new(NULL);
+            }
+            g_string_truncate(miner_slot->verdicts, 0);
+            g_string_truncate(miner_slot->selected, 0);
+        }
+    }
+    g_mutex_unlock(&g_miner_mutex);
+    return item;
+}
+
+const gchar *dataset_miner_next_image(guint slot, guint64 pts)
+{
+    const gchar *item = NULL;
+    if (slot >= DATASET_MINER_MAX_SLOTS)
+        return NULL;
+
+    g_mutex_lock(&g_miner_mutex);
+    MinerSlot *miner_slot = &g_slots[slot];
+    item = _peek_item();
+    if (miner_slot->images && item && dataset_miner_is_image(item))
+    {
+        _take_item();
+        _push_image(miner_slot, item, pts);
+    }
+    else
+    {
+        item = NULL;
+    }
+    g_mutex_unlock(&g_miner_mutex);
+    return item;
+}
+
+void dataset_miner_record_frame(guint slot, gint frame_num, guint64 pts, guint fp_count, guint tp_count,
+    gboolean selected)
+{
+    if (slot >= DATASET_MINER_MAX_SLOTS)
+        return;
+
+    g_mutex_lock(&g_miner_mutex);
+    MinerSlot *miner_slot = &g_slots[slot];
+    if (miner_slot->images)
+    {
+        /* Images pushed before this frame's image gave no frame */
+        MinerImage *image = NULL;
+        while ((image = g_queue_peek_head(&miner_slot->in_flight)) && (image->pts < pts))
+        {
+            _fail_item(image->item);
+            g_free(g_queue_pop_head(&miner_slot->in_flight));
+        }
+        if (image && (image->pts == pts))
+        {
+            fprintf(g_verdicts, "%s,0,%u,%u\n", image->item, fp_count, tp_count);
+            if (selected)
+                fprintf(g_selected, "%s 0\n", image->item);
+            fflush(g_verdicts);
+            fflush(g_selected);
+            fprintf(g_checkpoint, "%s\n", image->item);
+            fflush(g_checkpoint);
+            g_free(g_queue_pop_head(&miner_slot->in_flight));
+            g_frames++;
+            g_selected_frames += selected;
+            g_done++;
+        }
+    }
+    else if (miner_slot->item)
+    {
+        g_string_append_printf(miner_slot->verdicts, "%s,%d,%u,%u\n", miner_slot->item, frame_num, fp_count, tp_count);
+        if (selected)
+            g_string_append_printf(miner_slot->selected, "%s %d\n", miner_slot->item, frame_num);
+        g_frames++;
+        g_selected_frames += selected;
+    }
+    g_mutex_unlock(&g_miner_mutex);
+}
+
+gboolean dataset_miner_finish_slot(guint slot)
+{
+    gboolean ret = FALSE;
+    if (slot >= DATASET_MINER_MAX_SLOTS)
+        return FALSE;
+
+    g_mutex_lock(&g_miner_mutex);
+    MinerSlot *miner_slot = &g_slots[slot];
+    if (miner_slot->failed)
+    {
+        miner_slot->failed = FALSE;
+        ret = TRUE;
+    }
+    else if (miner_slot->images)
+    {
+        /* Every frame is in, images still in flight gave none */
+        MinerImage *image = NULL;
+        while ((image = g_queue_pop_head(&miner_slot->in_flight)))
+        {
+            _fail_item(image->item);
+            g_free(image);
+        }
+        miner_slot->images = FALSE;
+        ret = TRUE;
+    }
+    else if (miner_slot->item)
+    {
+        fputs(miner_slot->verdicts->str, g_verdicts);
+        fputs(miner_slot->selected->str, g_selected);
+        fflush(g_verdicts);
+        fflush(g_selected);
+        /* Checkpoint last, an item is done only once its verdicts are written */
+        fprintf(g_checkpoint, "%s\n", miner_slot->item);
+        fflush(g_checkpoint);
+        miner_slot->item = NULL;
+        g_done++;
+        ret = TRUE;
+    }
+    g_mutex_unlock(&g_miner_mutex);
+    return ret;
+}
+
+void dataset_miner_fail_slot(guint slot)
+{
+    if (slot >= DATASET_MINER_MAX_SLOTS)
+        return;
+
+    g_mutex_lock(&g_miner_mutex);
+    MinerSlot *miner_slot = &g_slots[slot];
+    if (miner_slot->images)
+    {
+        /* The oldest image is the one being decoded, the others get another slot */
+        MinerImage *image = g_queue_pop_head(&miner_slot->in_flight);
+        if (image)
+            _fail_item(image->item);
+        g_free(image);
+        while ((image = g_queue_pop_tail(&miner_slot->in_flight)))
+        {
+            g_queue_push_head(&g_retry, (gpointer) image->item);
+            g_free(image);
+        }
+        miner_slot->images = FALSE;
+        miner_slot->failed = TRUE;
+    }
+    else if (miner_slot->item)
+    {
+        _fail_item(miner_slot->item);
+        miner_slot->item = NULL;
+        miner_slot->failed = TRUE;
+    }
+    g_mutex_unlock(&g_miner_mutex);
+}
+
+guint dataset_miner_get_pending(void)
+{
+    g_mutex_lock(&g_miner_mutex);
+    guint pending = g_items->len - g_next_item + g_queue_get_length(&g_retry);
+    g_mutex_unlock(&g_miner_mutex);
+    return pending;
+}
+
+void dataset_miner_print(void)
+{
+    g_mutex_lock(&g_miner_mutex);
+    g_print("mining: items done: %u failed: %u skipped: %u pending: %u frames: %u selected: %u\n",
+        g_done, g_failed_cnt, g_skipped, g_items->len - g_next_item + g_queue_get_length(&g_retry),
+        g_frames, g_selected_frames);
+    g_mutex_unlock(&g_miner_mutex);
+}
+
+void dataset_miner_close(void)
+{
+    if (g_checkpoint)
+        fclose(g_checkpoint);
+    if (g_verdicts)
+        fclose(g_verdicts);
+    if (g_selected)
+        fclose(g_selected);
+    if (g_failed)
+        fclose(g_failed);
+    g_checkpoint = g_verdicts = g_selected = g_failed = NULL;
+}
@@ -25,64 +25,271 @@
 /**
  * 
  * @brief   Implements apis to link and unlink an element from pipeline dynamically (during runtime).
- * @todo    Apis only work when the elments in the LinkUnlinkInfo struct has static pads. Needs to be extended to support request pads.
+ *          New element is brought to PAUSED state by the caller thread before the pipeline is blocked,
+ *          so the block only covers relinking the pads. The buffer which triggers the block is
+ *          passed on through the new link and is not dropped. Pads of the neighbouring elements
+ *          can be static or request pads. A failed relink restores the previous links.
  * 
  */
 
+typedef struct {
+  LinkUnlinkInfo info;
+  GstPad *block_pad;          /* Blocked src pad of main_prev_prev_element, or of main_prev_element without it */
+  gulong block_probe_id;
+  gint64 start_time_us;       /* Time at which the operation was requested */
+  gint64 prepared_time_us;    /* Time at which the new element reached PAUSED */
+  gint64 block_time_us;       /* Time at which the pipeline got blocked */
+} LinkUnlinkOp;
+
+/* Returns the src pad of element with given name, or without a name the src pad
+ * currently linked to peer_element. Request pads are never requested here, the
+ * pad of interest is always an existing link. */
+static GstPad *
+get_linked_src_pad (GstElement *element, const gchar *pad_name, GstElement *peer_element)
+{
+  GstPad *pad = NULL;
+  GValue item = G_VALUE_INIT;
+  gboolean done = FALSE;
+
+  if (pad_name)
+    return gst_element_get_static_pad (element, pad_name);
+
+  GstIterator *it = gst_element_iterate_src_pads (element);
+  while (!done)
+  {
+    switch (gst_iterator_next (it, &item))
+    {
+      case GST_ITERATOR_OK:
+      {
+        GstPad *src_pad = GST_PAD (g_value_get_object (&item));
+        GstPad *peer = gst_pad_get_peer (src_pad);
+        if (peer)
+        {
+          GstElement *parent = gst_pad_get_parent_element (peer);
+          if (parent == peer_element)
+          {
+            pad = gst_object_ref (src_pad);
+            done = TRUE;
+          }
+          if (parent)
+            gst_object_unref (parent);
+          gst_object_unref (peer);
+        }
+        g_value_reset (&item);
+        break;
+      }
+      case GST_ITERATOR_RESYNC:
+        gst_iterator_resync (it);
+        break;
+      default:
+        done = TRUE;
+        break;
+    }
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+  return pad;
+}
+
+/* Src pad of main_prev_element linked to next, the main element or the element after it */
+static GstPad *
+get_prev_src_pad (LinkUnlinkInfo *info, GstElement *next)
+{
+  return get_linked_src_pad (info->main_prev_element, info->main_prev_src_pad_name, next);
+}
+
+static void
+free_link_unlink_op (LinkUnlinkOp *op)
+{
+  if (op->block_pad)
+    gst_object_unref (op->block_pad);
+  free(op);
+}
+
+static void
+print_swap_duration (LinkUnlinkOp *op, const gchar *operation)
+{
+  gint64 now = g_get_monotonic_time ();
+  g_print("%s element: prepare %.3f ms, wait for buffer %.3f ms, swap %.3f ms\n", operation,
+      (op->prepared_time_us - op->start_time_us) / 1000.0,
+      (op->block_time_us - op->prepared_time_us) / 1000.0,
+      (now - op->block_time_us) / 1000.0);
+}
+
+typedef struct {
+  GstElement *element;
+  gboolean added;
+  link_unlink_failed_callback failed_cb;
+} FailedOp;
+
+/* Reports a restored link from the main loop. An element which could not be
+ * added is taken out of the pipeline first. */
+static gboolean
+handle_failed_op (gpointer user_data)
+{
+  FailedOp *failed = (FailedOp *) user_data;
+
+  if (failed->added)
+  {
+    gst_element_set_state (failed->element, GST_STATE_NULL);
+    GstObject *parent = gst_object_get_parent (GST_OBJECT (failed->element));
+    if (parent)
+    {
+      gst_bin_remove (GST_BIN (parent), failed->element);
+      gst_object_unref (parent);
+    }
+  }
+
+  if (failed->failed_cb)
+    failed->failed_cb (failed->element, failed->added);
+  gst_object_unref (failed->element);
+  free (failed);
+  return FALSE;
+}
+
+static void
+report_failed_op (LinkUnlinkInfo *info, gboolean added)
+{
+  FailedOp *failed = (FailedOp *) calloc (1, sizeof (FailedOp));
+  failed->element = gst_object_ref (info->main_element);
+  failed->added = added;
+  failed->failed_cb = info->failed_cb;
+  g_idle_add (handle_failed_op, failed);
+}
+
 static GstPadProbeReturn
 add_elem_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
 {
-  LinkUnlinkInfo *link_unlink_info = (LinkUnlinkInfo *)user_data;
-  gst_pad_remove_probe (pad, GST_PAD_PROBE_INFO_ID (info));
-  g_print ("Adding element\n");
+  LinkUnlinkOp *op = (LinkUnlinkOp *)user_data;
+  LinkUnlinkInfo *link_unlink_info = &op->info;
+  GstPad *src_pad = NULL, *sink_pad = NULL, *elem_sink_pad = NULL, *elem_src_pad = NULL;
 
-  gst_bin_add (GST_BIN (link_unlink_info->pipeline), link_unlink_info->main_element);
+  op->block_time_us = g_get_monotonic_time ();
+  g_print ("Adding element\n");
 
-  GstPad *src_pad  = gst_element_get_static_pad (link_unlink_info->main_prev_element, "src");
-  GstPad *sink_pad = gst_element_get_static_pad (link_unlink_info->main_next_element, "sink");
+  src_pad = get_prev_src_pad (link_unlink_info, link_unlink_info->main_next_element);
+  sink_pad = src_pad ? gst_pad_get_peer (src_pad) : NULL;
+  elem_sink_pad = gst_element_get_static_pad (link_unlink_info->main_element, "sink");
+  elem_src_pad = gst_element_get_static_pad (link_unlink_info->main_element, "src");
 
-  if (!src_pad || !sink_pad)
+  if (!src_pad || !sink_pad || !elem_sink_pad || !elem_src_pad)
   {
     g_print("src_pad or sink_pad is NULL\n");
-    return FALSE;
+    goto done;
   }
 
-  gboolean unlink_status = gst_pad_unlink (src_pad, sink_pad);
-  if (!unlink_status)
+  if (!gst_pad_unlink (src_pad, sink_pad))
   {
     g_print("unlink failed\n");
-    return GST_PAD_PROBE_DROP;
+    goto done;
   }
 
-  gst_object_unref (src_pad);
-  gst_object_unref (sink_pad);
+  g_print("linking..\n");
+  if ((gst_pad_link (src_pad, elem_sink_pad) != GST_PAD_LINK_OK) ||
+      (gst_pad_link (elem_src_pad, sink_pad) != GST_PAD_LINK_OK))
+  {
+    /* Put the original link back, the pipeline keeps running without the element */
+    g_print("link failed, restoring previous link\n");
+    if (gst_pad_is_linked (src_pad))
+      gst_pad_unlink (src_pad, elem_sink_pad);
+    if (gst_pad_is_linked (elem_src_pad))
+      gst_pad_unlink (elem_src_pad, sink_pad);
+    if (gst_pad_link (src_pad, sink_pad) != GST_PAD_LINK_OK)
+      g_print("restoring link failed\n");
+    report_failed_op (link_unlink_info, TRUE);
+    goto done;
+  }
 
+  /* Element is already prepared, PAUSED to PLAYING does not load anything */
+  gst_element_sync_state_with_parent (link_unlink_info->main_element);
+  print_swap_duration (op, "add");
 
-  g_print("linking..\n");
-  gst_element_link_many (link_unlink_info->main_prev_element, link_unlink_info->main_element, link_unlink_info->main_next_element, NULL);
-  gst_element_set_state (link_unlink_info->main_element, GST_STATE_PLAYING);
-  free(link_unlink_info);
-  return GST_PAD_PROBE_DROP;
+done:
+  if (src_pad)
+    gst_object_unref (src_pad);
+  if (sink_pad)
+    gst_object_unref (sink_pad);
+  if (elem_sink_pad)
+    gst_object_unref (elem_sink_pad);
+  if (elem_src_pad)
+    gst_object_unref (elem_src_pad);
+  free_link_unlink_op (op);
+  /* Unblock, the blocked buffer continues through the new link */
+  return GST_PAD_PROBE_REMOVE;
 }
 
+/* Stops and releases the removed element from the main loop, outside of the streaming threads */
+static gboolean
+release_removed_elem (gpointer user_data)
+{
+  LinkUnlinkOp *op = (LinkUnlinkOp *)user_data;
+  gint64 start = g_get_monotonic_time ();
+
+  gst_element_set_state (op->info.main_element, GST_STATE_NULL);
+  gst_bin_remove (GST_BIN (op->info.pipeline), op->info.main_element);
+
+  g_print("remove element: teardown %.3f ms\n", (g_get_monotonic_time () - start) / 1000.0);
+  free_link_unlink_op (op);
+  return FALSE;
+}
 
 static GstPadProbeReturn
 remove_elem_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
 {
-  LinkUnlinkInfo *link_unlink_info = (LinkUnlinkInfo *)user_data;
+  LinkUnlinkOp *op = (LinkUnlinkOp *)user_data;
+  LinkUnlinkInfo *link_unlink_info = &op->info;
+  GstPad *src_pad = NULL, *sink_pad = NULL, *elem_sink_pad = NULL;
+  gboolean restored = FALSE;
 
   if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_DATA (info)) != GST_EVENT_EOS)
     return GST_PAD_PROBE_PASS;
 
   gst_pad_remove_probe (pad, GST_PAD_PROBE_INFO_ID (info));
 
-  gst_element_set_state (link_unlink_info->main_element, GST_STATE_NULL);
+  /* Element is drained, relink its neighbours directly */
+  elem_sink_pad = gst_element_get_static_pad (link_unlink_info->main_element, "sink");
+  src_pad = gst_pad_get_peer (elem_sink_pad);
+  sink_pad = gst_pad_get_peer (pad);
 
-  /* remove unlinks automatically */
-  gst_bin_remove (GST_BIN (link_unlink_info->pipeline), link_unlink_info->main_element);
+  if (src_pad && sink_pad)
+  {
+    gst_pad_unlink (src_pad, elem_sink_pad);
+    gst_pad_unlink (pad, sink_pad);
+    if (gst_pad_link (src_pad, sink_pad) != GST_PAD_LINK_OK)
+    {
+      /* Keep the element in place. It is drained and at EOS, a flush makes it
+       * accept data again. */
+      g_print("link failed, restoring previous link\n");
+      if ((gst_pad_link (src_pad, elem_sink_pad) != GST_PAD_LINK_OK) ||
+          (gst_pad_link (pad, sink_pad) != GST_PAD_LINK_OK))
+        g_print("restoring link failed\n");
+      gst_pad_send_event (elem_sink_pad, gst_event_new_flush_start ());
+      gst_pad_send_event (elem_sink_pad, gst_event_new_flush_stop (FALSE));
+      restored = TRUE;
+    }
+  }
+  else
+  {
+    g_print("src_pad or sink_pad is NULL\n");
+  }
+
+  if (src_pad)
+    gst_object_unref (src_pad);
+  if (sink_pad)
+    gst_object_unref (sink_pad);
+  gst_object_unref (elem_sink_pad);
+
+  print_swap_duration (op, "remove");
 
-  gst_element_link_many (link_unlink_info->main_prev_element, link_unlink_info->main_next_element, NULL);
-  free(link_unlink_info);
+  /* Unblock upstream, buffers flow through the new link */
+  gst_pad_remove_probe (op->block_pad, op->block_probe_id);
+  if (restored)
+  {
+    report_failed_op (link_unlink_info, FALSE);
+    free_link_unlink_op (op);
+  }
+  else
+    g_idle_add (release_removed_elem, op);
   return GST_PAD_PROBE_DROP;
 }
 
@@ -90,8 +297,15 @@ static GstPadProbeReturn
 pad_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
 {
   GstPad *srcpad = NULL, *sinkpad = NULL;
-  LinkUnlinkInfo *link_unlink_info = (LinkUnlinkInfo *)user_data;
-  gst_pad_remove_probe (pad, GST_PAD_PROBE_INFO_ID (info));
+  LinkUnlinkOp *op = (LinkUnlinkOp *)user_data;
+  LinkUnlinkInfo *link_unlink_info = &op->info;
+
+  /* Only the first blocked buffer starts the removal */
+  if (op->block_time_us)
+    return GST_PAD_PROBE_OK;
+
+  op->block_time_us = g_get_monotonic_time ();
+  op->block_probe_id = GST_PAD_PROBE_INFO_ID (info);
 
   /* install new probe for EOS */
   srcpad = gst_element_get_static_pad (link_unlink_info->main_element, "src");
@@ -99,7 +313,9 @@ pad_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
   gst_object_unref (srcpad);
 
   /* push EOS into the element, the probe will be fired when the
-   * EOS leaves the element and it has thus drained all of its data */
+   * EOS leaves the element and it has thus drained all of its data.
+   * Upstream stays blocked until then, so no buffer reaches the
+   * element after EOS. */
   sinkpad = gst_element_get_static_pad (link_unlink_info->main_element, "sink");
   gst_pad_send_event (sinkpad, gst_event_new_eos ());
   gst_object_unref (sinkpad);
@@ -107,47 +323,61 @@ pad_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
   return GST_PAD_PROBE_OK;
 }
 
-static LinkUnlinkInfo *make_copy_link_unlink_info(LinkUnlinkInfo *info)
+/* next is the element main_prev_element currently feeds */
+static LinkUnlinkOp *create_link_unlink_op(LinkUnlinkInfo *info, GstElement *next)
 {
-  LinkUnlinkInfo *info_copy = (LinkUnlinkInfo *) malloc(sizeof(LinkUnlinkInfo));
-  info_copy->main_element = info->main_element;
-  info_copy->main_prev_element = info->main_prev_element;
-  info_copy->main_prev_prev_element = info->main_prev_prev_element;
-  info_copy->main_next_element = info->main_next_element;
-  info_copy->pipeline = info->pipeline;
-  info_copy->loop = info->loop;
-
-  return info_copy;
+  LinkUnlinkOp *op = (LinkUnlinkOp *) calloc(1, sizeof(LinkUnlinkOp));
+  op->info = *info;
+  op->start_time_us = g_get_monotonic_time ();
+  op->prepared_time_us = op->start_time_us;
+  if (info->main_prev_prev_element)
+    op->block_pad = get_linked_src_pad (info->main_prev_prev_element,
+        info->main_prev_prev_src_pad_name, info->main_prev_element);
+  else
+    op->block_pad = get_prev_src_pad (info, next);
+
+  return op;
 }
 
 gboolean
 add_element_to_pipeline (LinkUnlinkInfo *info)
 {
-  info = make_copy_link_unlink_info(info);
-  GstPad *block_src_pad = gst_element_get_static_pad (info->main_prev_prev_element, "src"); /* Needs to be extended to support request pads */
-  if (!block_src_pad)
+  LinkUnlinkOp *op = create_link_unlink_op(info, info->main_next_element);
+  if (!op->block_pad)
   {
     g_print("block_src_pad is NULL\n");
+    free_link_unlink_op (op);
+    return FALSE;
+  }
+
+  /* Bring the element up (model loading etc.) in the caller thread while the
+   * pipeline keeps running. Only relinking happens in the blocked thread. */
+  gst_bin_add (GST_BIN (op->info.pipeline), op->info.main_element);
+  if (gst_element_set_state (op->info.main_element, GST_STATE_PAUSED) == GST_STATE_CHANGE_FAILURE)
+  {
+    g_print("element state change failed\n");
+    gst_element_set_state (op->info.main_element, GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (op->info.pipeline), op->info.main_element);
+    free_link_unlink_op (op);
     return FALSE;
   }
+  op->prepared_time_us = g_get_monotonic_time ();
 
-  gst_pad_add_probe (block_src_pad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, add_elem_probe_cb, info, NULL);
-  gst_object_unref (block_src_pad);
+  gst_pad_add_probe (op->block_pad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, add_elem_probe_cb, op, NULL);
   return TRUE;
 }
 
 gboolean
 remove_element_from_pipeline (LinkUnlinkInfo *info)
 {
-  info = make_copy_link_unlink_info(info);
-  GstPad *block_src_pad = gst_element_get_static_pad (info->main_prev_prev_element, "src"); /* Needs to be extended to support request pads */
-  if (!block_src_pad)
+  LinkUnlinkOp *op = create_link_unlink_op(info, info->main_element);
+  if (!op->block_pad)
   {
     g_print("block_src_pad is NULL\n");
+    free_link_unlink_op (op);
     return FALSE;
   }
 
-  gst_pad_add_probe (block_src_pad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, pad_probe_cb, info, NULL);
-  gst_object_unref (block_src_pad);
+  gst_pad_add_probe (op->block_pad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, pad_probe_cb, op, NULL);
   return TRUE;
 }
@@ -0,0 +1,170 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   Per stream spatial cache of false positive verdicts. Static false positives
+ *          (posters, reflections) come back at the same place every frame, so a box
+ *          matching a recent verdict can reuse it instead of being assessed again.
+ *          Verdicts are keyed by quantized box edges and do not need tracker ids.
+ * 
+ */
+
+#include <string.h>
+#include "ds_fp_cache.h"
+
+typedef struct {
+    gboolean used;
+    gint left, top, right, bottom;  /* quantized edges */
+    gint validated_frame;           /* frame of the last assessor verdict */
+    gint last_seen_frame;
+} FpCacheEntry;
+
+static GMutex g_cache_mutex;
+static FpCacheEntry g_cache[FP_CACHE_MAX_STREAMS][FP_CACHE_MAX_ENTRIES];
+static guint g_cell_px = 16;
+static guint g_revalidate_frames = 30;
+static guint g_max_age_frames = 60;
+
+void fp_cache_init(guint cell_px, guint revalidate_frames, guint max_age_frames)
+{
+    g_mutex_lock(&g_cache_mutex);
+    g_cell_px = MAX(1, cell_px);
+    g_revalidate_frames = revalidate_frames;
+    g_max_age_frames = max_age_frames;
+    memset(g_cache, 0, sizeof(g_cache));
+    g_mutex_unlock(&g_cache_mutex);
+}
+
+static void _quantize(NvOSD_RectParams *rect, FpCacheEntry *key)
+{
+    key->left = (gint) (rect->left / g_cell_px);
+    key->top = (gint) (rect->top / g_cell_px);
+    key->right = (gint) ((rect->left + rect->width) / g_cell_px);
+    key->bottom = (gint) ((rect->top + rect->height) / g_cell_px);
+}
+
+static gboolean _matches(FpCacheEntry *entry, FpCacheEntry *key)
+{
+    return entry->used && (ABS(entry->left - key->left) <= 1) && (ABS(entry->top - key->top) <= 1) &&
+        (ABS(entry->right - key->right) <= 1) && (ABS(entry->bottom - key->bottom) <= 1);
+}
+
+/* Frame numbers restart when a source is re-added, entries from the future are stale too */
+static gboolean _expired(FpCacheEntry *entry, gint frame_num)
+{
+    return (frame_num < entry->last_seen_frame) ||
+        ((guint) (frame_num - entry->last_seen_frame) > g_max_age_frames);
+}
+
+gboolean fp_cache_lookup(guint stream, gint frame_num, NvOSD_RectParams *rect)
+{
+    FpCacheEntry key;
+    gboolean hit = FALSE;
+
+    if (stream >= FP_CACHE_MAX_STREAMS)
+        return FALSE;
+
+    _quantize(rect, &key);
+    g_mutex_lock(&g_cache_mutex);
+    for (guint idx = 0; idx < FP_CACHE_MAX_ENTRIES; idx++)
+    {
+        FpCacheEntry *entry = &g_cache[stream][idx];
+        if (!entry->used)
+            continue;
+        if (_expired(entry, frame_num))
+        {
+            entry->used = FALSE;
+            continue;
+        }
+        if (!_matches(entry, &key))
+            continue;
+
+        entry->last_seen_frame = frame_num;
+        /* Let the assessors confirm the verdict every revalidate_frames frames */
+        hit = (guint) (frame_num - entry->validated_frame) < g_revalidate_frames;
+        break;
+    }
+    g_mutex_unlock(&g_cache_mutex);
+    return hit;
+}
+
+void fp_cache_add_fp(guint stream, gint frame_num, NvOSD_RectParams *rect)
+{
+    FpCacheEntry key;
+    FpCacheEntry *slot = NULL;
+
+    if (stream >= FP_CACHE_MAX_STREAMS)
+        return;
+
+    _quantize(rect, &key);
+    g_mutex_lock(&g_cache_mutex);
+    for (guint idx = 0; idx < FP_CACHE_MAX_ENTRIES; idx++)
+    {
+        FpCacheEntry *entry = &g_cache[stream][idx];
+        if (_matches(entry, &key))
+        {
+            slot = entry;
+            break;
+        }
+        /* Otherwise take a free slot or evict the least recently seen entry */
+        if (!slot || (slot->used && (!entry->used || (entry->last_seen_frame < slot->last_seen_frame))))
+            slot = entry;
+    }
+
+    if (!slot->used)
+    {
+        *slot = key;
+        slot->used = TRUE;
+    }
+    slot->validated_frame = frame_num;
+    slot->last_seen_frame = frame_num;
+    g_mutex_unlock(&g_cache_mutex);
+}
+
+void fp_cache_remove(guint stream, NvOSD_RectParams *rect)
+{
+    FpCacheEntry key;
+
+    if (stream >= FP_CACHE_MAX_STREAMS)
+        return;
+
+    _quantize(rect, &key);
+    g_mutex_lock(&g_cache_mutex);
+    for (guint idx = 0; idx < FP_CACHE_MAX_ENTRIES; idx++)
+    {
+        if (_matches(&g_cache[stream][idx], &key))
+            g_cache[stream][idx].used = FALSE;
+    }
+    g_mutex_unlock(&g_cache_mutex);
+}
+
+void fp_cache_clear_stream(guint stream)
+{
+    if (stream >= FP_CACHE_MAX_STREAMS)
+        return;
+
+    g_mutex_lock(&g_cache_mutex);
+    memset(g_cache[stream], 0, sizeof(g_cache[stream]));
+    g_mutex_unlock(&g_cache_mutex);
+}
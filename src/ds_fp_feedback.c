@@ -0,0 +1,299 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   Feeds false positive tracks confirmed behind fpfilter back to the tracker.
+ *          Confirmations travel upstream as custom events, so sender and receiver only
+ *          share the pad path. Detections of confirmed tracks are dropped before the
+ *          tracker and the assessors spend time on them again.
+ * 
+ */
+
+#include <string.h>
+#include "ds_fp_feedback.h"
+
+/* Overlap of a detection with the last box of a confirmed track to be dropped */
+#define FP_FEEDBACK_IOU_THRESHOLD   0.5
+
+typedef struct {
+    gboolean used;
+    guint64 object_id;
+    gint class_id;
+    NvOSD_RectParams rect;
+    gint confirmed_frame;
+    gint last_frame;
+} ConfirmedTrack;
+
+static guint g_confirm_frames = 10;
+static guint g_ttl_frames = 300;
+static gint g_pgie_id = -1;
+
+/* Sender state, only touched on the fpfilter streaming thread */
+static GHashTable *g_fp_streaks[FP_FEEDBACK_MAX_STREAMS];
+
+/* Receiver state */
+static GMutex g_tracks_mutex;
+static ConfirmedTrack g_tracks[FP_FEEDBACK_MAX_STREAMS][FP_FEEDBACK_MAX_TRACKS];
+static gint g_dropped_before = 0;
+static gint g_dropped_after = 0;
+static gint g_confirmed = 0;
+
+void fp_feedback_init(guint confirm_frames, guint ttl_frames)
+{
+    g_confirm_frames = MAX(1, confirm_frames);
+    g_ttl_frames = ttl_frames;
+    g_mutex_init(&g_tracks_mutex);
+    for (guint idx = 0; idx < FP_FEEDBACK_MAX_STREAMS; idx++)
+        g_fp_streaks[idx] = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+}
+
+static void _send_confirmation(GstPad *sink_pad, guint stream, gint frame_num, guint64 object_id,
+    gint class_id, NvOSD_RectParams *rect)
+{
+    GstStructure *structure = gst_structure_new(FP_FEEDBACK_EVENT_NAME,
+        "stream", G_TYPE_UINT, stream,
+        "object-id", G_TYPE_UINT64, object_id,
+        "class-id", G_TYPE_INT, class_id,
+        "frame", G_TYPE_INT, frame_num,
+        "left", G_TYPE_DOUBLE, (gdouble) rect->left,
+        "top", G_TYPE_DOUBLE, (gdouble) rect->top,
+        "width", G_TYPE_DOUBLE, (gdouble) rect->width,
+        "height", G_TYPE_DOUBLE, (gdouble) rect->height, NULL);
+    gst_pad_push_event(sink_pad, gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM, structure));
+}
+
+void fp_feedback_record_verdict(GstPad *sink_pad, guint stream, gint frame_num, guint64 object_id,
+    gint class_id, NvOSD_RectParams *rect, gboolean is_fp)
+{
+    if ((stream >= FP_FEEDBACK_MAX_STREAMS) || (object_id == UNTRACKED_OBJECT_ID))
+        return;
+
+    GHashTable *streaks = g_fp_streaks[stream];
+    if (!is_fp)
+    {
+        g_hash_table_remove(streaks, &object_id);
+        return;
+    }
+
+    guint streak = GPOINTER_TO_UINT(g_hash_table_lookup(streaks, &object_id)) + 1;
+    /* Ids of tracks which ended while false positive are never removed otherwise */
+    if ((streak == 1) && (g_hash_table_size(streaks) >= 4 * FP_FEEDBACK_MAX_TRACKS))
+        g_hash_table_remove_all(streaks);
+    g_hash_table_insert(streaks, g_memdup(&object_id, sizeof(object_id)), GUINT_TO_POINTER(streak));
+
+    /* Sent once, when the streak reaches the threshold */
+    if (streak == g_confirm_frames)
+        _send_confirmation(sink_pad, stream, frame_num, object_id, class_id, rect);
+}
+
+static void _add_track(guint stream, guint64 object_id, gint class_id, gint frame_num, NvOSD_RectParams *rect)
+{
+    ConfirmedTrack *slot = NULL;
+
+    g_mutex_lock(&g_tracks_mutex);
+    for (guint idx = 0; idx < FP_FEEDBACK_MAX_TRACKS; idx++)
+    {
+        ConfirmedTrack *track = &g_tracks[stream][idx];
+        if (track->used && (track->object_id == object_id))
+        {
+            slot = track;
+            break;
+        }
+        /* Otherwise a free slot or the oldest confirmation */
+        if (!slot || (slot->used && (!track->used || (track->confirmed_frame < slot->confirmed_frame))))
+            slot = track;
+    }
+    slot->used = TRUE;
+    slot->object_id = object_id;
+    slot->class_id = class_id;
+    slot->rect = *rect;
+    slot->confirmed_frame = frame_num;
+    slot->last_frame = frame_num;
+    g_mutex_unlock(&g_tracks_mutex);
+    g_atomic_int_inc(&g_confirmed);
+}
+
+static GstPadProbeReturn
+_event_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if ((GST_EVENT_TYPE(event) != GST_EVENT_CUSTOM_UPSTREAM) ||
+        !gst_event_has_name(event, FP_FEEDBACK_EVENT_NAME))
+        return GST_PAD_PROBE_OK;
+
+    const GstStructure *structure = gst_event_get_structure(event);
+    guint stream = 0;
+    guint64 object_id = 0;
+    gint class_id = 0;
+    gint frame_num = 0;
+    gdouble left = 0, top = 0, width = 0, height = 0;
+    if (gst_structure_get(structure, "stream", G_TYPE_UINT, &stream, "object-id", G_TYPE_UINT64, &object_id,
+            "class-id", G_TYPE_INT, &class_id, "frame", G_TYPE_INT, &frame_num, "left", G_TYPE_DOUBLE, &left, "top", G_TYPE_DOUBLE, &top,
+            "width", G_TYPE_DOUBLE, &width, "height", G_TYPE_DOUBLE, &height, NULL) &&
+        (stream < FP_FEEDBACK_MAX_STREAMS))
+    {
+        NvOSD_RectParams rect = {0,};
+        rect.left = left;
+        rect.top = top;
+        rect.width = width;
+        rect.height = height;
+        _add_track(stream, object_id, class_id, frame_num, &rect);
+    }
+    /* Consumed here, elements further upstream do not know it */
+    return GST_PAD_PROBE_DROP;
+}
+
+static gdouble _iou(NvOSD_RectParams *a, NvOSD_RectParams *b)
+{
+    gdouble x0 = MAX(a->left, b->left);
+    gdouble y0 = MAX(a->top, b->top);
+    gdouble x1 = MIN(a->left + a->width, b->left + b->width);
+    gdouble y1 = MIN(a->top + a->height, b->top + b->height);
+    if ((x1 <= x0) || (y1 <= y0))
+        return 0;
+    gdouble intersection = (x1 - x0) * (y1 - y0);
+    return intersection / (a->width * a->height + b->width * b->height - intersection);
+}
+
+/* Returns TRUE if the object belongs to a confirmed track of its class, matched by id or
+ * by overlap. Only tracker output moves the track's box, a detection dropped by overlap
+ * may be a different object next to it. */
+static gboolean _match_track(guint stream, gint frame_num, NvDsObjectMeta *obj, gboolean by_id)
+{
+    gboolean match = FALSE;
+
+    g_mutex_lock(&g_tracks_mutex);
+    for (guint idx = 0; idx < FP_FEEDBACK_MAX_TRACKS; idx++)
+    {
+        ConfirmedTrack *track = &g_tracks[stream][idx];
+        if (!track->used)
+            continue;
+        /* Frame numbers restart when a source is re-added */
+        if ((frame_num < track->confirmed_frame) || ((guint) (frame_num - track->confirmed_frame) > g_ttl_frames))
+        {
+            track->used = FALSE;
+            continue;
+        }
+        if (track->class_id != obj->class_id)
+            continue;
+        if (by_id ? (track->object_id == obj->object_id) :
+            (_iou(&track->rect, &obj->rect_params) >= FP_FEEDBACK_IOU_THRESHOLD))
+        {
+            if (by_id)
+                track->rect = obj->rect_params;
+            track->last_frame = frame_num;
+            match = TRUE;
+            break;
+        }
+    }
+    g_mutex_unlock(&g_tracks_mutex);
+    return match;
+}
+
+static void _drop_confirmed(GstBuffer *buf, gboolean by_id)
+{
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(buf);
+    if (!batch_meta)
+        return;
+
+    for (NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next)
+    {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        GList *dropped = NULL;
+        if (frame_meta->pad_index >= FP_FEEDBACK_MAX_STREAMS)
+            continue;
+
+        for (NvDsMetaList *l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next)
+        {
+            NvDsObjectMeta *obj = (NvDsObjectMeta *) l_obj->data;
+            if ((obj->unique_component_id == g_pgie_id) &&
+                _match_track(frame_meta->pad_index, frame_meta->frame_num, obj, by_id))
+                dropped = g_list_prepend(dropped, obj);
+        }
+
+        for (GList *l = dropped; l != NULL; l = l->next)
+            nvds_remove_obj_meta_from_frame(frame_meta, (NvDsObjectMeta *) l->data);
+        g_atomic_int_add(by_id ? &g_dropped_after : &g_dropped_before, g_list_length(dropped));
+        g_list_free(dropped);
+    }
+}
+
+static GstPadProbeReturn
+_before_tracker_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    _drop_confirmed(GST_PAD_PROBE_INFO_BUFFER(info), FALSE);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+_after_tracker_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    _drop_confirmed(GST_PAD_PROBE_INFO_BUFFER(info), TRUE);
+    return GST_PAD_PROBE_OK;
+}
+
+gboolean fp_feedback_attach_receiver(GstElement *tracker, gint pgie_id)
+{
+    GstPad *sink_pad = gst_element_get_static_pad(tracker, "sink");
+    GstPad *src_pad = gst_element_get_static_pad(tracker, "src");
+    gboolean ret = sink_pad && src_pad;
+
+    g_pgie_id = pgie_id;
+    if (ret)
+    {
+        gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, _before_tracker_probe, NULL, NULL);
+        gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, _after_tracker_probe, NULL, NULL);
+        gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, _event_probe, NULL, NULL);
+    }
+    else
+    {
+        g_print("fp feedback: tracker pads not found\n");
+    }
+
+    if (sink_pad)
+        gst_object_unref(sink_pad);
+    if (src_pad)
+        gst_object_unref(src_pad);
+    return ret;
+}
+
+void fp_feedback_clear_stream(guint stream)
+{
+    if (stream >= FP_FEEDBACK_MAX_STREAMS)
+        return;
+
+    g_mutex_lock(&g_tracks_mutex);
+    memset(g_tracks[stream], 0, sizeof(g_tracks[stream]));
+    g_mutex_unlock(&g_tracks_mutex);
+}
+
+guint fp_feedback_get_dropped(gboolean before_tracker)
+{
+    return g_atomic_int_get(before_tracker ? &g_dropped_before : &g_dropped_after);
+}
+
+guint fp_feedback_get_confirmed(void)
+{
+    return g_atomic_int_get(&g_confirmed);
+}
@@ -0,0 +1,182 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   Keeps rolling per stream and per class false positive statistics, so consumers
+ *          read aggregated windows instead of walking fpfilter meta of every frame.
+ * 
+ */
+
+#include <string.h>
+#include "ds_fp_stats.h"
+
+typedef struct {
+    gint64 second;
+    FpStatsWindow counts;
+} FpStatsBucket;
+
+static guint g_window_s = 10;
+static GMutex g_stats_mutex;
+static FpStatsBucket g_buckets[FP_STATS_MAX_STREAMS][FP_STATS_MAX_WINDOW_S];
+
+void fp_stats_init(guint window_s)
+{
+    g_window_s = CLAMP(window_s, 1, FP_STATS_MAX_WINDOW_S);
+    g_mutex_init(&g_stats_mutex);
+}
+
+/* Returns the bucket of the current second, called with the mutex held */
+static FpStatsWindow *_current_counts(guint stream)
+{
+    gint64 second = g_get_monotonic_time() / G_USEC_PER_SEC;
+    FpStatsBucket *bucket = &g_buckets[stream][second % g_window_s];
+    if (bucket->second != second)
+    {
+        memset(&bucket->counts, 0, sizeof(bucket->counts));
+        bucket->second = second;
+    }
+    return &bucket->counts;
+}
+
+void fp_stats_add_frame(guint stream, guint fp_count, guint tp_count)
+{
+    if (stream >= FP_STATS_MAX_STREAMS)
+        return;
+
+    g_mutex_lock(&g_stats_mutex);
+    FpStatsWindow *counts = _current_counts(stream);
+    counts->frames++;
+    counts->fp_count += fp_count;
+    counts->tp_count += tp_count;
+    g_mutex_unlock(&g_stats_mutex);
+}
+
+void fp_stats_add_object(guint stream, gint class_id, gfloat confidence, gboolean is_fp)
+{
+    if (stream >= FP_STATS_MAX_STREAMS)
+        return;
+
+    guint bin = CLAMP((gint) (confidence * FP_STATS_SCORE_BINS), 0, FP_STATS_SCORE_BINS - 1);
+    g_mutex_lock(&g_stats_mutex);
+    FpStatsWindow *counts = _current_counts(stream);
+    if ((class_id >= 0) && (class_id < FP_STATS_MAX_CLASSES))
+    {
+        if (is_fp)
+            counts->class_fp[class_id]++;
+        else
+            counts->class_tp[class_id]++;
+    }
+    if (is_fp)
+        counts->fp_scores[bin]++;
+    else
+        counts->tp_scores[bin]++;
+    g_mutex_unlock(&g_stats_mutex);
+}
+
+gboolean fp_stats_get(guint stream, FpStatsWindow *window)
+{
+    memset(window, 0, sizeof(*window));
+    if (stream >= FP_STATS_MAX_STREAMS)
+        return FALSE;
+
+    gint64 second = g_get_monotonic_time() / G_USEC_PER_SEC;
+    g_mutex_lock(&g_stats_mutex);
+    for (guint idx = 0; idx < g_window_s; idx++)
+    {
+        FpStatsBucket *bucket = &g_buckets[stream][idx];
+        if (bucket->second <= second - g_window_s)
+            continue;
+        window->frames += bucket->counts.frames;
+        window->fp_count += bucket->counts.fp_count;
+        window->tp_count += bucket->counts.tp_count;
+        for (guint cls = 0; cls < FP_STATS_MAX_CLASSES; cls++)
+        {
+            window->class_fp[cls] += bucket->counts.class_fp[cls];
+            window->class_tp[cls] += bucket->counts.class_tp[cls];
+        }
+        for (guint bin = 0; bin < FP_STATS_SCORE_BINS; bin++)
+        {
+            window->fp_scores[bin] += bucket->counts.fp_scores[bin];
+            window->tp_scores[bin] += bucket->counts.tp_scores[bin];
+        }
+    }
+    g_mutex_unlock(&g_stats_mutex);
+    return window->frames > 0;
+}
+
+static void _set_histogram(GstStructure *structure, const gchar *field, guint *bins)
+{
+    GValue array = G_VALUE_INIT;
+    GValue value = G_VALUE_INIT;
+    g_value_init(&array, GST_TYPE_ARRAY);
+    g_value_init(&value, G_TYPE_UINT);
+    for (guint bin = 0; bin < FP_STATS_SCORE_BINS; bin++)
+    {
+        g_value_set_uint(&value, bins[bin]);
+        gst_value_array_append_value(&array, &value);
+    }
+    gst_structure_take_value(structure, field, &array);
+    g_value_unset(&value);
+}
+
+GstStructure *fp_stats_new_structure(guint stream, FpStatsWindow *window)
+{
+    guint total = window->fp_count + window->tp_count;
+    GstStructure *structure = gst_structure_new(FP_STATS_MESSAGE_NAME,
+        "stream", G_TYPE_UINT, stream,
+        "window", G_TYPE_UINT, g_window_s,
+        "frames", G_TYPE_UINT, window->frames,
+        "fp", G_TYPE_UINT, window->fp_count,
+        "tp", G_TYPE_UINT, window->tp_count,
+        "fp-rate", G_TYPE_DOUBLE, total ? (gdouble) window->fp_count / total : 0.0, NULL);
+
+    for (guint cls = 0; cls < FP_STATS_MAX_CLASSES; cls++)
+    {
+        if (!window->class_fp[cls] && !window->class_tp[cls])
+            continue;
+        gchar field[32] = {0,};
+        g_snprintf(field, sizeof(field), "fp-class-%u", cls);
+        gst_structure_set(structure, field, G_TYPE_UINT, window->class_fp[cls], NULL);
+        g_snprintf(field, sizeof(field), "tp-class-%u", cls);
+        gst_structure_set(structure, field, G_TYPE_UINT, window->class_tp[cls], NULL);
+    }
+    _set_histogram(structure, "fp-scores", window->fp_scores);
+    _set_histogram(structure, "tp-scores", window->tp_scores);
+    return structure;
+}
+
+guint fp_stats_get_window_s(void)
+{
+    return g_window_s;
+}
+
+void fp_stats_clear_stream(guint stream)
+{
+    if (stream >= FP_STATS_MAX_STREAMS)
+        return;
+
+    g_mutex_lock(&g_stats_mutex);
+    memset(g_buckets[stream], 0, sizeof(g_buckets[stream]));
+    g_mutex_unlock(&g_stats_mutex);
+}
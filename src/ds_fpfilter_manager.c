@@ -22,83 +22,354 @@
 
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
 #include "glib.h"
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <netinet/ip.h>
 
 /**
- * @brief   Implements simple client application to send messages to server hosted by DS app.
+ * @brief   Implements simple client application to send messages to servers hosted by DS apps.
+ *          Messages are sent to all targets concurrently, one thread and one connection per
+ *          target. Every message on a connection is acknowledged by the app before the next
+ *          one is sent, and a summary of acknowledgements and latencies is printed at the end.
  */
 
+#define DEFAULT_MONITOR_HOST    "127.0.0.1"
 #define DEFAULT_MONITOR_PORT     43434
 #define MAX_PACKET_LEN          (4 * 1024)
+#define DEFAULT_TIMEOUT_MS       2000
 
-//send data to server.
-static void _send_buf_to_ds_app(const guchar *buffer, guint buffer_len)
+typedef struct {
+    gchar *host;
+    gchar *port;
+    gboolean ok;
+    guint acked;
+    gdouble total_latency_ms;
+    gdouble max_latency_ms;
+    gchar error[256];
+} Target;
+
+static gchar **g_message_files = NULL;
+static gchar **g_target_list = NULL;
+static gchar *g_targets_file = NULL;
+static gint g_timeout_ms = DEFAULT_TIMEOUT_MS;
+
+static GOptionEntry g_option_entries[] = {
+    { "message", 'm', 0, G_OPTION_ARG_FILENAME_ARRAY, &g_message_files,
+      "File containing json message, can be given more than once to send several messages in order", "FILE" },
+    { "target", 't', 0, G_OPTION_ARG_STRING_ARRAY, &g_target_list,
+      "DS app to send to as host:port, can be given more than once (default " DEFAULT_MONITOR_HOST ":43434)", "HOST:PORT" },
+    { "targets-file", 'f', 0, G_OPTION_ARG_FILENAME, &g_targets_file,
+      "File with one host:port per line, lines starting with # are ignored", "FILE" },
+    { "timeout", 'T', 0, G_OPTION_ARG_INT, &g_timeout_ms,
+      "Connect, send and acknowledgement timeout per message in ms (default 2000)", "MS" },
+    { NULL },
+};
+
+/* Messages shared by all target threads, read only */
+static GPtrArray *g_messages = NULL;
+
+static gboolean _write_all(gint fd, const guchar *buffer, gsize len)
 {
-    guint sock = 0; 
-    struct sockaddr_in serv_addr; 
+    gsize sent_len = 0;
+    while (sent_len < len)
+    {
+        ssize_t ret = send(fd, buffer + sent_len, len - sent_len, MSG_NOSIGNAL);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        sent_len += ret;
+    }
+    return TRUE;
+}
 
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) 
-    { 
-        g_print("Socket creation error \n"); 
-        return;
+static gboolean _read_all(gint fd, guchar *buffer, gsize len)
+{
+    gsize read_len = 0;
+    while (read_len < len)
+    {
+        ssize_t ret = recv(fd, buffer + read_len, len - read_len, 0);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        /* 0 is a closed connection, timeouts show up as EAGAIN */
+        if (ret <= 0)
+            return FALSE;
+        read_len += ret;
     }
+    return TRUE;
+}
 
-    serv_addr.sin_family = AF_INET; 
-    serv_addr.sin_port = htons(DEFAULT_MONITOR_PORT);
-    serv_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+/* Connects with a timeout, the socket is blocking with send/receive timeouts afterwards */
+static gint _connect(Target *target)
+{
+    struct addrinfo hints = {0,}, *addrs = NULL;
+    gint sock = -1;
 
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) 
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    gint ret = getaddrinfo(target->host, target->port, &hints, &addrs);
+    if (ret != 0)
     {
-        g_print("Connection Failed \n");
-        return;
+        g_snprintf(target->error, sizeof(target->error), "resolve failed: %s", gai_strerror(ret));
+        return -1;
     }
 
-    guchar write_buffer[MAX_PACKET_LEN] = {0,};
-    guint write_buffer_len = 0;
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        g_snprintf(target->error, sizeof(target->error), "socket creation error: %s", strerror(errno));
+        goto done;
+    }
 
-    guint16 len = (guint16) buffer_len;
-    memcpy(write_buffer, &len, 2);
-    write_buffer_len += 2;
+    gint flags = fcntl(sock, F_GETFL);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    if ((connect(sock, addrs->ai_addr, addrs->ai_addrlen) < 0) && (errno != EINPROGRESS))
+    {
+        g_snprintf(target->error, sizeof(target->error), "connection failed: %s", strerror(errno));
+        goto fail;
+    }
 
-    memcpy(write_buffer + write_buffer_len, buffer, buffer_len);
-    write_buffer_len += buffer_len;
+    struct pollfd pfd = { sock, POLLOUT, 0 };
+    gint so_error = 0;
+    socklen_t so_error_len = sizeof(so_error);
+    if (poll(&pfd, 1, g_timeout_ms) <= 0)
+    {
+        g_snprintf(target->error, sizeof(target->error), "connection timed out");
+        goto fail;
+    }
+    getsockopt(sock, SOL_SOCKET, SO_ERROR, &so_error, &so_error_len);
+    if (so_error)
+    {
+        g_snprintf(target->error, sizeof(target->error), "connection failed: %s", strerror(so_error));
+        goto fail;
+    }
+
+    fcntl(sock, F_SETFL, flags);
+    struct timeval timeout = { g_timeout_ms / 1000, (g_timeout_ms % 1000) * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    goto done;
+
+fail:
+    close(sock);
+    sock = -1;
+done:
+    freeaddrinfo(addrs);
+    return sock;
+}
+
+/* Sends a message framed by its 16 bit length and waits for the acknowledgement */
+static gboolean _send_message(Target *target, gint sock, GBytes *message)
+{
+    gsize len = 0;
+    const guchar *data = g_bytes_get_data(message, &len);
+    guchar write_buffer[MAX_PACKET_LEN + 2] = {0,};
+    guint16 msg_len = (guint16) len;
+    memcpy(write_buffer, &msg_len, 2);
+    memcpy(write_buffer + 2, data, len);
+
+    gint64 start_us = g_get_monotonic_time();
+    if (!_write_all(sock, write_buffer, len + 2))
+    {
+        g_snprintf(target->error, sizeof(target->error), "send failed: %s", strerror(errno));
+        return FALSE;
+    }
 
-    int sent_len = 0;
-    while (sent_len != write_buffer_len)
+    guchar ack[MAX_PACKET_LEN] = {0,};
+    guint16 ack_len = 0;
+    if (!_read_all(sock, (guchar *) &ack_len, 2) || (ack_len >= MAX_PACKET_LEN) || !_read_all(sock, ack, ack_len))
+    {
+        g_snprintf(target->error, sizeof(target->error), "no acknowledgement after %u message(s)", target->acked);
+        return FALSE;
+    }
+    if (strcmp((gchar *) ack, "ok"))
     {
-        sent_len += write(sock, write_buffer + sent_len, write_buffer_len - sent_len);
+        g_snprintf(target->error, sizeof(target->error), "message rejected: %s", ack);
+        return FALSE;
     }
 
-    close(sock); //close socket
+    gdouble latency_ms = (g_get_monotonic_time() - start_us) / 1000.0;
+    target->acked++;
+    target->total_latency_ms += latency_ms;
+    target->max_latency_ms = MAX(target->max_latency_ms, latency_ms);
+    return TRUE;
 }
 
-int
-main(int argc, char *argv[])
+/* Sends all messages to one target over one connection */
+static gpointer _target_task(gpointer arg)
 {
-    if (argc != 3)
+    Target *target = (Target *) arg;
+    gint sock = _connect(target);
+    if (sock < 0)
+        return NULL;
+
+    target->ok = TRUE;
+    for (guint idx = 0; idx < g_messages->len; idx++)
     {
-        g_print("usage: %s -m <message>\n", argv[0]);
-        return 0;
+        if (!_send_message(target, sock, g_ptr_array_index(g_messages, idx)))
+        {
+            target->ok = FALSE;
+            break;
+        }
     }
+    close(sock);
+    return NULL;
+}
 
-    if (strcmp(argv[1], "-m") != 0)
+static gboolean _add_target(GPtrArray *targets, const gchar *spec)
+{
+    gchar *stripped = g_strstrip(g_strdup(spec));
+    if (!strlen(stripped) || (stripped[0] == '#'))
+    {
+        g_free(stripped);
+        return TRUE;
+    }
+
+    Target *target = g_new0(Target, 1);
+    gchar *colon = strrchr(stripped, ':');
+    if (colon)
+    {
+        *colon = '\0';
+        target->host = g_strdup(strlen(stripped) ? stripped : DEFAULT_MONITOR_HOST);
+        target->port = g_strdup(colon + 1);
+    }
+    else
+    {
+        target->host = g_strdup(stripped);
+        target->port = g_strdup_printf("%d", DEFAULT_MONITOR_PORT);
+    }
+    g_free(stripped);
+
+    if (!g_ascii_string_to_unsigned(target->port, 10, 1, G_MAXUINT16, NULL, NULL))
+    {
+        g_print("invalid target: %s\n", spec);
+        g_free(target->host);
+        g_free(target->port);
+        g_free(target);
+        return FALSE;
+    }
+    g_ptr_array_add(targets, target);
+    return TRUE;
+}
+
+static gboolean _load_targets(GPtrArray *targets)
+{
+    for (gchar **spec = g_target_list; spec && *spec; spec++)
+    {
+        if (!_add_target(targets, *spec))
+            return FALSE;
+    }
+
+    if (g_targets_file)
+    {
+        gchar *contents = NULL;
+        if (!g_file_get_contents(g_targets_file, &contents, NULL, NULL))
+        {
+            g_print("targets file open failed\n");
+            return FALSE;
+        }
+        gchar **lines = g_strsplit(contents, "\n", -1);
+        gboolean ret = TRUE;
+        for (gchar **line = lines; *line && ret; line++)
+            ret = _add_target(targets, *line);
+        g_strfreev(lines);
+        g_free(contents);
+        if (!ret)
+            return FALSE;
+    }
+
+    if (!targets->len)
+        _add_target(targets, DEFAULT_MONITOR_HOST ":43434");
+    return TRUE;
+}
+
+static gboolean _load_messages(void)
+{
+    g_messages = g_ptr_array_new_with_free_func((GDestroyNotify) g_bytes_unref);
+    for (gchar **file = g_message_files; *file; file++)
+    {
+        gchar *contents = NULL;
+        gsize len = 0;
+        if (!g_file_get_contents(*file, &contents, &len, NULL))
+        {
+            g_print("file open failed: %s\n", *file);
+            return FALSE;
+        }
+        if (len > MAX_PACKET_LEN - 1)
+        {
+            g_print("message too long: %s\n", *file);
+            g_free(contents);
+            return FALSE;
+        }
+        g_ptr_array_add(g_messages, g_bytes_new_take(contents, len));
+    }
+    return TRUE;
+}
+
+int
+main(int argc, char *argv[])
+{
+    GError *error = NULL;
+    GOptionContext *ctx = g_option_context_new("- send json messages to DS apps");
+    g_option_context_add_main_entries(ctx, g_option_entries, NULL);
+    if (!g_option_context_parse(ctx, &argc, &argv, &error) || !g_message_files)
     {
-        g_print("usage: %s -m <message>\n", argv[0]);
-        return 0;
+        g_print("usage: %s -m <message> [-m <message> ...] [-t host:port ...] [-f <targets_file>] [-T <timeout_ms>]\n", argv[0]);
+        if (error)
+            g_error_free(error);
+        g_option_context_free(ctx);
+        return 1;
     }
+    g_option_context_free(ctx);
+
+    GPtrArray *targets = g_ptr_array_new();
+    if (!_load_messages() || !_load_targets(targets))
+        return 1;
+
+    gint64 start_us = g_get_monotonic_time();
+    GThread **threads = g_new0(GThread *, targets->len);
+    for (guint idx = 0; idx < targets->len; idx++)
+        threads[idx] = g_thread_new("fpfilter manager target", _target_task, g_ptr_array_index(targets, idx));
+    for (guint idx = 0; idx < targets->len; idx++)
+        g_thread_join(threads[idx]);
+    gdouble total_ms = (g_get_monotonic_time() - start_us) / 1000.0;
 
-    FILE *file = NULL;
-    file = fopen (argv[2], "r");
-    if (!file)
+    guint ok_cnt = 0;
+    gdouble max_latency_ms = 0;
+    for (guint idx = 0; idx < targets->len; idx++)
     {
-        g_print("file open failed\n");
-        return 0;
+        Target *target = g_ptr_array_index(targets, idx);
+        if (target->ok)
+        {
+            ok_cnt++;
+            max_latency_ms = MAX(max_latency_ms, target->max_latency_ms);
+            g_print("%s:%s ok, %u/%u acked, latency avg %.2f ms max %.2f ms\n", target->host, target->port,
+                target->acked, g_messages->len, target->total_latency_ms / MAX(1, target->acked),
+                target->max_latency_ms);
+        }
+        else
+        {
+            g_print("%s:%s failed, %u/%u acked: %s\n", target->host, target->port,
+                target->acked, g_messages->len, target->error);
+        }
+        g_free(target->host);
+        g_free(target->port);
+        g_free(target);
     }
+    g_print("summary: %u/%u targets ok, max message latency %.2f ms, total %.2f ms\n",
+        ok_cnt, targets->len, max_latency_ms, total_ms);
 
-    guchar buffer[MAX_PACKET_LEN] = {0,};
-    size_t len = fread(buffer, 1, MAX_PACKET_LEN - 1, file);
-    _send_buf_to_ds_app(buffer, len);
-    return 0;
+    g_free(threads);
+    g_ptr_array_free(targets, TRUE);
+    g_ptr_array_free(g_messages, TRUE);
+    return (ok_cnt == targets->len) ? 0 : 1;
 }
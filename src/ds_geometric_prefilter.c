@@ -0,0 +1,258 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   Cheap per class geometric checks on primary boxes in front of the assessors.
+ *          Boxes with implausible size, aspect ratio, confidence or position are
+ *          rejected right away, confident boxes skip assessment, and only the
+ *          uncertain rest reaches the assessors and fpfilter.
+ * 
+ */
+
+#include <string.h>
+#include "ds_geometric_prefilter.h"
+
+#define CONFIG_GROUP_CLASS_ATTRS_ALL        "class-attrs-all"
+#define CONFIG_GROUP_CLASS_ATTRS_PREFIX     "class-attrs-"
+#define CONFIG_GROUP_ROI_STREAM_PREFIX      "roi-stream-"
+#define CONFIG_KEY_MIN_WIDTH                "min-width"
+#define CONFIG_KEY_MIN_HEIGHT               "min-height"
+#define CONFIG_KEY_MAX_WIDTH                "max-width"
+#define CONFIG_KEY_MAX_HEIGHT               "max-height"
+#define CONFIG_KEY_MIN_ASPECT_RATIO         "min-aspect-ratio"
+#define CONFIG_KEY_MAX_ASPECT_RATIO         "max-aspect-ratio"
+#define CONFIG_KEY_REJECT_CONFIDENCE        "reject-confidence"
+#define CONFIG_KEY_PASS_CONFIDENCE          "pass-confidence"
+#define CONFIG_KEY_POLYGON                  "polygon"
+
+/* 0 means no limit */
+typedef struct {
+    gdouble min_width, min_height;
+    gdouble max_width, max_height;
+    gdouble min_aspect_ratio, max_aspect_ratio;
+    gdouble reject_confidence;
+    gdouble pass_confidence;
+} ClassAttrs;
+
+typedef struct {
+    guint num_points;
+    gdouble x[PREFILTER_MAX_ROI_POINTS];
+    gdouble y[PREFILTER_MAX_ROI_POINTS];
+} RoiPolygon;
+
+static ClassAttrs g_class_attrs[PREFILTER_MAX_CLASSES];
+static RoiPolygon g_roi[PREFILTER_MAX_STREAMS];
+static gint g_counts[PREFILTER_RESULT_MAX];
+static const gchar *g_result_names[PREFILTER_RESULT_MAX] = {
+    "reject-size", "reject-aspect-ratio", "reject-confidence", "reject-roi", "pass-confidence", "assess"
+};
+
+static void _parse_class_attrs(GKeyFile *key_file, const gchar *group, ClassAttrs *attrs)
+{
+    struct { const gchar *key; gdouble *value; } keys[] = {
+        { CONFIG_KEY_MIN_WIDTH, &attrs->min_width },
+        { CONFIG_KEY_MIN_HEIGHT, &attrs->min_height },
+        { CONFIG_KEY_MAX_WIDTH, &attrs->max_width },
+        { CONFIG_KEY_MAX_HEIGHT, &attrs->max_height },
+        { CONFIG_KEY_MIN_ASPECT_RATIO, &attrs->min_aspect_ratio },
+        { CONFIG_KEY_MAX_ASPECT_RATIO, &attrs->max_aspect_ratio },
+        { CONFIG_KEY_REJECT_CONFIDENCE, &attrs->reject_confidence },
+        { CONFIG_KEY_PASS_CONFIDENCE, &attrs->pass_confidence },
+    };
+
+    for (guint idx = 0; idx < G_N_ELEMENTS(keys); idx++)
+    {
+        if (g_key_file_has_key(key_file, group, keys[idx].key, NULL))
+            *keys[idx].value = g_key_file_get_double(key_file, group, keys[idx].key, NULL);
+    }
+}
+
+static gboolean _parse_roi(GKeyFile *key_file, const gchar *group, RoiPolygon *roi)
+{
+    gsize len = 0;
+    gdouble *values = g_key_file_get_double_list(key_file, group, CONFIG_KEY_POLYGON, &len, NULL);
+    gboolean ret = values && (len >= 6) && !(len % 2) && (len / 2 <= PREFILTER_MAX_ROI_POINTS);
+
+    if (ret)
+    {
+        roi->num_points = len / 2;
+        for (guint idx = 0; idx < roi->num_points; idx++)
+        {
+            roi->x[idx] = values[2 * idx];
+            roi->y[idx] = values[2 * idx + 1];
+        }
+    }
+    else
+    {
+        g_printerr("%s: polygon needs 3 to %d x;y points\n", group, PREFILTER_MAX_ROI_POINTS);
+    }
+    g_free(values);
+    return ret;
+}
+
+gboolean prefilter_init(const gchar *cfg_file_path)
+{
+    GKeyFile *key_file = g_key_file_new();
+    GError *error = NULL;
+    gchar **groups = NULL;
+    gboolean ret = FALSE;
+    ClassAttrs defaults = { 0, 0, 0, 0, 0, 0, 0, 1.1 };
+
+    memset(g_roi, 0, sizeof(g_roi));
+    memset(g_counts, 0, sizeof(g_counts));
+
+    if (!g_key_file_load_from_file(key_file, cfg_file_path, G_KEY_FILE_NONE, &error))
+    {
+        g_printerr("Failed to load config file: %s\n", error->message);
+        goto done;
+    }
+
+    if (g_key_file_has_group(key_file, CONFIG_GROUP_CLASS_ATTRS_ALL))
+        _parse_class_attrs(key_file, CONFIG_GROUP_CLASS_ATTRS_ALL, &defaults);
+    for (guint idx = 0; idx < PREFILTER_MAX_CLASSES; idx++)
+        g_class_attrs[idx] = defaults;
+
+    groups = g_key_file_get_groups(key_file, NULL);
+    for (gchar **group = groups; *group; group++)
+    {
+        if (!g_strcmp0(*group, CONFIG_GROUP_CLASS_ATTRS_ALL))
+            continue;
+
+        if (g_str_has_prefix(*group, CONFIG_GROUP_CLASS_ATTRS_PREFIX))
+        {
+            guint64 class_id = g_ascii_strtoull(*group + strlen(CONFIG_GROUP_CLASS_ATTRS_PREFIX), NULL, 10);
+            if (class_id >= PREFILTER_MAX_CLASSES)
+            {
+                g_printerr("Invalid class id in group %s\n", *group);
+                goto done;
+            }
+            _parse_class_attrs(key_file, *group, &g_class_attrs[class_id]);
+        }
+        else if (g_str_has_prefix(*group, CONFIG_GROUP_ROI_STREAM_PREFIX))
+        {
+            guint64 stream = g_ascii_strtoull(*group + strlen(CONFIG_GROUP_ROI_STREAM_PREFIX), NULL, 10);
+            if ((stream >= PREFILTER_MAX_STREAMS) || !_parse_roi(key_file, *group, &g_roi[stream]))
+            {
+                g_printerr("Invalid roi in group %s\n", *group);
+                goto done;
+            }
+        }
+    }
+    ret = TRUE;
+
+done:
+    g_strfreev(groups);
+    g_key_file_free(key_file);
+    if (error)
+        g_error_free(error);
+    return ret;
+}
+
+/* Ray casting, points on the boundary may fall either way */
+static gboolean _inside_roi(RoiPolygon *roi, gdouble x, gdouble y)
+{
+    gboolean inside = FALSE;
+    for (guint i = 0, j = roi->num_points - 1; i < roi->num_points; j = i++)
+    {
+        if (((roi->y[i] > y) != (roi->y[j] > y)) &&
+            (x < (roi->x[j] - roi->x[i]) * (y - roi->y[i]) / (roi->y[j] - roi->y[i]) + roi->x[i]))
+            inside = !inside;
+    }
+    return inside;
+}
+
+static PrefilterResult _check_object(guint stream, NvDsObjectMeta *obj)
+{
+    ClassAttrs *attrs = &g_class_attrs[CLAMP(obj->class_id, 0, PREFILTER_MAX_CLASSES - 1)];
+    NvOSD_RectParams *rect = &obj->rect_params;
+
+    if ((attrs->min_width && (rect->width < attrs->min_width)) ||
+        (attrs->min_height && (rect->height < attrs->min_height)) ||
+        (attrs->max_width && (rect->width > attrs->max_width)) ||
+        (attrs->max_height && (rect->height > attrs->max_height)))
+        return PREFILTER_REJECT_SIZE;
+
+    if (rect->height > 0)
+    {
+        gdouble aspect_ratio = rect->width / rect->height;
+        if ((attrs->min_aspect_ratio && (aspect_ratio < attrs->min_aspect_ratio)) ||
+            (attrs->max_aspect_ratio && (aspect_ratio > attrs->max_aspect_ratio)))
+            return PREFILTER_REJECT_ASPECT_RATIO;
+    }
+
+    if (obj->confidence < attrs->reject_confidence)
+        return PREFILTER_REJECT_CONFIDENCE;
+
+    /* Bottom center is where the object stands */
+    if ((stream < PREFILTER_MAX_STREAMS) && g_roi[stream].num_points &&
+        !_inside_roi(&g_roi[stream], rect->left + rect->width / 2, rect->top + rect->height))
+        return PREFILTER_REJECT_ROI;
+
+    if (obj->confidence >= attrs->pass_confidence)
+        return PREFILTER_PASS_CONFIDENCE;
+
+    return PREFILTER_ASSESS;
+}
+
+void prefilter_process_frame(NvDsFrameMeta *frame_meta, gint pgie_id, gint pass_component_id)
+{
+    GList *rejected = NULL;
+
+    for (NvDsMetaList *l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next)
+    {
+        NvDsObjectMeta *obj = (NvDsObjectMeta *) l_obj->data;
+        if (obj->unique_component_id != pgie_id)
+            continue;
+
+        PrefilterResult result = _check_object(frame_meta->pad_index, obj);
+        g_atomic_int_inc(&g_counts[result]);
+        if (result == PREFILTER_PASS_CONFIDENCE)
+            obj->unique_component_id = pass_component_id;
+        else if (result != PREFILTER_ASSESS)
+            rejected = g_list_prepend(rejected, obj);
+    }
+
+    /* Removed after the walk, removing unlinks the object from obj_meta_list */
+    for (GList *l = rejected; l != NULL; l = l->next)
+        nvds_remove_obj_meta_from_frame(frame_meta, (NvDsObjectMeta *) l->data);
+    g_list_free(rejected);
+}
+
+guint prefilter_get_count(PrefilterResult result)
+{
+    return g_atomic_int_get(&g_counts[result]);
+}
+
+const gchar *prefilter_result_name(PrefilterResult result)
+{
+    return g_result_names[result];
+}
+
+void prefilter_print(void)
+{
+    g_print("prefilter:");
+    for (guint idx = 0; idx < PREFILTER_RESULT_MAX; idx++)
+        g_print(" %s %u", g_result_names[idx], prefilter_get_count(idx));
+    g_print("\n");
+}
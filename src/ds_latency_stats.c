@@ -0,0 +1,140 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * 
+ * @brief   Implements latency histograms which can be updated from streaming threads without locks
+ *          and read at any time from other threads.
+ *          Each histogram is a single array of counters shared by all threads and updated with
+ *          atomic increments, there are no per thread shards. Threads recording into the same
+ *          histogram contend on its cache lines; the application records each histogram from
+ *          the streaming thread of a single element.
+ *          Optional USDT tracepoints (build with -DENABLE_USDT) let perf/bpftrace attach to every
+ *          recorded sample: deepstream_fpfilter:latency(name, duration_ns).
+ * 
+ */
+
+#include <string.h>
+#include "ds_latency_stats.h"
+
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+#endif
+
+#define SUB_BUCKETS (1 << LATENCY_STATS_SUB_BUCKET_BITS)
+
+static guint
+_bucket_index(guint64 value)
+{
+    if (value < SUB_BUCKETS)
+        return (guint) value;
+
+    guint msb = 63 - __builtin_clzll(value);
+    guint sub = (value >> (msb - LATENCY_STATS_SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (msb - LATENCY_STATS_SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+/* Middle of the value range which falls into the bucket */
+static guint64
+_bucket_value(guint index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+
+    guint msb = index / SUB_BUCKETS + LATENCY_STATS_SUB_BUCKET_BITS - 1;
+    guint shift = msb - LATENCY_STATS_SUB_BUCKET_BITS;
+    guint64 sub = index % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub) << shift) + ((G_GUINT64_CONSTANT(1) << shift) >> 1);
+}
+
+void
+latency_stats_init(LatencyStats *stats, const gchar *name)
+{
+    memset(stats, 0, sizeof(LatencyStats));
+    stats->name = name;
+}
+
+void
+latency_stats_record(LatencyStats *stats, guint64 duration_ns)
+{
+#ifdef ENABLE_USDT
+    DTRACE_PROBE2(deepstream_fpfilter, latency, stats->name, duration_ns);
+#endif
+
+    g_atomic_int_inc(&stats->buckets[_bucket_index(duration_ns)]);
+    g_atomic_int_inc(&stats->count);
+    __atomic_fetch_add(&stats->sum_ns, duration_ns, __ATOMIC_RELAXED);
+
+    gint duration_us = (gint) MIN(duration_ns / 1000, G_MAXINT);
+    gint max_us = g_atomic_int_get(&stats->max_us);
+    while (duration_us > max_us)
+    {
+        if (g_atomic_int_compare_and_exchange(&stats->max_us, max_us, duration_us))
+            break;
+        max_us = g_atomic_int_get(&stats->max_us);
+    }
+}
+
+guint64
+latency_stats_percentile(LatencyStats *stats, gdouble percentile)
+{
+    gint count = g_atomic_int_get(&stats->count);
+    if (count == 0)
+        return 0;
+
+    gint64 target = (gint64) (count * percentile / 100.0);
+    gint64 seen = 0;
+    for (guint idx = 0; idx < LATENCY_STATS_NUM_BUCKETS; idx++)
+    {
+        seen += g_atomic_int_get(&stats->buckets[idx]);
+        if (seen > target)
+            return _bucket_value(idx);
+    }
+    return _bucket_value(LATENCY_STATS_NUM_BUCKETS - 1);
+}
+
+guint64
+latency_stats_sum(LatencyStats *stats)
+{
+    return __atomic_load_n(&stats->sum_ns, __ATOMIC_RELAXED);
+}
+
+void
+latency_stats_print(LatencyStats *stats)
+{
+    g_print("%-24s count: %8d p50: %8.3f ms p90: %8.3f ms p99: %8.3f ms max: %8.3f ms\n",
+        stats->name, g_atomic_int_get(&stats->count),
+        latency_stats_percentile(stats, 50) / 1000000.0,
+        latency_stats_percentile(stats, 90) / 1000000.0,
+        latency_stats_percentile(stats, 99) / 1000000.0,
+        g_atomic_int_get(&stats->max_us) / 1000.0);
+}
+
+void
+latency_stats_reset(LatencyStats *stats)
+{
+    for (guint idx = 0; idx < LATENCY_STATS_NUM_BUCKETS; idx++)
+        g_atomic_int_set(&stats->buckets[idx], 0);
+    g_atomic_int_set(&stats->count, 0);
+    __atomic_store_n(&stats->sum_ns, 0, __ATOMIC_RELAXED);
+    g_atomic_int_set(&stats->max_us, 0);
+}
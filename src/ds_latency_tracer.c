@@ -0,0 +1,209 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * 
+ * @brief   Implements opt-in per element and per stream latency tracing using pad probes.
+ *          Batches are matched between pads by their PTS, which streammux assigns and downstream
+ *          elements keep. Tracing is enabled with DS_FPFILTER_LATENCY_TRACE=1.
+ * 
+ */
+
+#include <stdlib.h>
+#include "gstnvdsmeta.h"
+#include "ds_latency_tracer.h"
+#include "ds_latency_stats.h"
+#include "ds_pending_batches.h"
+
+#define MAX_TRACED_STREAMS      64
+
+typedef struct {
+    gchar *name;
+    PendingBatches pending;
+    LatencyStats stats;
+} TracedElement;
+
+static gboolean g_tracer_enabled = FALSE;
+static GMutex g_tracer_mutex;
+static GPtrArray *g_traced_elements = NULL;
+static PendingBatches g_origin;
+static LatencyStats *g_stream_stats[MAX_TRACED_STREAMS];
+static gchar *g_stream_names[MAX_TRACED_STREAMS];
+
+static gboolean _add_buffer_probe(GstElement *element, const gchar *pad_name, GstPadProbeCallback cb, gpointer user_data)
+{
+    GstPad *pad = gst_element_get_static_pad(element, pad_name);
+    if (!pad)
+    {
+        g_print("latency tracer: %s pad not found\n", pad_name);
+        return FALSE;
+    }
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, cb, user_data, NULL);
+    gst_object_unref(pad);
+    return TRUE;
+}
+
+static GstPadProbeReturn
+_origin_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    pending_batches_push(&g_origin, GST_BUFFER_PTS(buf), g_get_monotonic_time());
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+_element_sink_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    TracedElement *traced = (TracedElement *) user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    pending_batches_push(&traced->pending, GST_BUFFER_PTS(buf), g_get_monotonic_time());
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+_element_src_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    TracedElement *traced = (TracedElement *) user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    gint64 start_us = pending_batches_find(&traced->pending, GST_BUFFER_PTS(buf));
+    if (start_us)
+        latency_stats_record(&traced->stats, (g_get_monotonic_time() - start_us) * 1000);
+    return GST_PAD_PROBE_OK;
+}
+
+static LatencyStats *_get_stream_stats(guint stream)
+{
+    LatencyStats *stats = NULL;
+    g_mutex_lock(&g_tracer_mutex);
+    if (!g_stream_stats[stream])
+    {
+        g_stream_names[stream] = g_strdup_printf("stream %u end-to-end", stream);
+        g_stream_stats[stream] = (LatencyStats *) malloc(sizeof(LatencyStats));
+        latency_stats_init(g_stream_stats[stream], g_stream_names[stream]);
+    }
+    stats = g_stream_stats[stream];
+    g_mutex_unlock(&g_tracer_mutex);
+    return stats;
+}
+
+static GstPadProbeReturn
+_end_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    gint64 start_us = pending_batches_find(&g_origin, GST_BUFFER_PTS(buf));
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(buf);
+    if (!start_us || !batch_meta)
+        return GST_PAD_PROBE_OK;
+
+    guint64 latency_ns = (g_get_monotonic_time() - start_us) * 1000;
+    for (NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next)
+    {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        if (frame_meta->pad_index < MAX_TRACED_STREAMS)
+            latency_stats_record(_get_stream_stats(frame_meta->pad_index), latency_ns);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void
+latency_tracer_init(void)
+{
+    g_tracer_enabled = !g_strcmp0(g_getenv(LATENCY_TRACER_ENV), "1");
+    g_mutex_init(&g_tracer_mutex);
+    pending_batches_init(&g_origin);
+    g_traced_elements = g_ptr_array_new();
+}
+
+gboolean
+latency_tracer_is_enabled(void)
+{
+    return g_tracer_enabled;
+}
+
+gboolean
+latency_tracer_set_origin(GstElement *element)
+{
+    if (!g_tracer_enabled)
+        return TRUE;
+    return _add_buffer_probe(element, "src", _origin_probe, NULL);
+}
+
+gboolean
+latency_tracer_add_element(GstElement *element, const gchar *name)
+{
+    TracedElement *traced = NULL;
+
+    if (!g_tracer_enabled)
+        return TRUE;
+
+    g_mutex_lock(&g_tracer_mutex);
+    for (guint idx = 0; idx < g_traced_elements->len; idx++)
+    {
+        TracedElement *entry = (TracedElement *) g_ptr_array_index(g_traced_elements, idx);
+        if (!g_strcmp0(entry->name, name))
+        {
+            traced = entry;
+            break;
+        }
+    }
+
+    if (!traced)
+    {
+        traced = (TracedElement *) calloc(1, sizeof(TracedElement));
+        traced->name = g_strdup(name);
+        pending_batches_init(&traced->pending);
+        latency_stats_init(&traced->stats, traced->name);
+        g_ptr_array_add(g_traced_elements, traced);
+    }
+    g_mutex_unlock(&g_tracer_mutex);
+
+    return _add_buffer_probe(element, "sink", _element_sink_probe, traced) &&
+        _add_buffer_probe(element, "src", _element_src_probe, traced);
+}
+
+gboolean
+latency_tracer_set_end(GstElement *element)
+{
+    if (!g_tracer_enabled)
+        return TRUE;
+    return _add_buffer_probe(element, "sink", _end_probe, NULL);
+}
+
+void
+latency_tracer_print(void)
+{
+    if (!g_tracer_enabled)
+    {
+        g_print("latency tracer is disabled, set %s=1 to enable\n", LATENCY_TRACER_ENV);
+        return;
+    }
+
+    g_mutex_lock(&g_tracer_mutex);
+    for (guint idx = 0; idx < g_traced_elements->len; idx++)
+        latency_stats_print(&((TracedElement *) g_ptr_array_index(g_traced_elements, idx))->stats);
+    for (guint idx = 0; idx < MAX_TRACED_STREAMS; idx++)
+    {
+        if (g_stream_stats[idx])
+            latency_stats_print(g_stream_stats[idx]);
+    }
+    g_mutex_unlock(&g_tracer_mutex);
+}
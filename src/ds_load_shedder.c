@@ -0,0 +1,161 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   Steps the pipeline through cheaper processing levels while it falls behind
+ *          and back when it has caught up. Lateness is taken from a per batch time
+ *          budget, measured from the origin element by PTS, and from QoS events sent
+ *          upstream by synchronized sinks.
+ * 
+ */
+
+#include "ds_load_shedder.h"
+#include "ds_pending_batches.h"
+
+static GMutex g_shedder_mutex;
+static PendingBatches g_pending;
+
+static guint g_num_levels = 1;
+static gint64 g_budget_us = 0;
+static load_shedder_callback g_level_cb = NULL;
+static gint g_level = 0;
+static guint g_late_cnt = 0;
+static guint g_ok_cnt = 0;
+
+void load_shedder_init(guint num_levels, guint budget_ms, load_shedder_callback cb)
+{
+    g_mutex_init(&g_shedder_mutex);
+    pending_batches_init(&g_pending);
+    g_num_levels = MAX(1, num_levels);
+    g_budget_us = (gint64) budget_ms * 1000;
+    g_level_cb = cb;
+}
+
+/* Counts a late or timely batch and moves one level when the streak is long enough */
+static void _update(gboolean late, gboolean well_within)
+{
+    gint new_level = -1;
+
+    g_mutex_lock(&g_shedder_mutex);
+    gint level = g_atomic_int_get(&g_level);
+    g_late_cnt = late ? g_late_cnt + 1 : 0;
+    g_ok_cnt = well_within ? g_ok_cnt + 1 : 0;
+
+    if ((g_late_cnt >= LOAD_SHEDDER_DEGRADE_BATCHES) && (level + 1 < (gint) g_num_levels))
+        new_level = level + 1;
+    else if ((g_ok_cnt >= LOAD_SHEDDER_RECOVER_BATCHES) && (level > 0))
+        new_level = level - 1;
+
+    if (new_level >= 0)
+    {
+        g_atomic_int_set(&g_level, new_level);
+        g_late_cnt = 0;
+        g_ok_cnt = 0;
+        /* Under the lock, so level changes from the buffer and QoS paths are applied
+         * in the order they were made */
+        if (g_level_cb)
+            g_level_cb(new_level);
+    }
+    g_mutex_unlock(&g_shedder_mutex);
+}
+
+static GstPadProbeReturn
+_origin_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    pending_batches_push(&g_pending, GST_BUFFER_PTS(buf), g_get_monotonic_time());
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+_watch_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+    {
+        /* Without a budget only QoS events count, timely batches would reset their streak */
+        if (!g_budget_us)
+            return GST_PAD_PROBE_OK;
+        gint64 start_us = pending_batches_find(&g_pending, GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info)));
+        if (!start_us)
+            return GST_PAD_PROBE_OK;
+        gint64 latency_us = g_get_monotonic_time() - start_us;
+        _update(latency_us > g_budget_us, latency_us < g_budget_us / 2);
+    }
+    else
+    {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_QOS)
+        {
+            GstQOSType type;
+            gdouble proportion;
+            GstClockTimeDiff diff;
+            GstClockTime timestamp;
+            gst_event_parse_qos(event, &type, &proportion, &diff, &timestamp);
+            /* Positive diff is how late the buffer arrived at the sink, on time counts
+             * towards recovery like a batch within budget */
+            _update(diff > 0, diff <= 0);
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+gboolean load_shedder_set_origin(GstElement *element)
+{
+    GstPad *pad = gst_element_get_static_pad(element, "src");
+    if (!pad)
+    {
+        g_print("load shedder: src pad not found\n");
+        return FALSE;
+    }
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, _origin_probe, NULL, NULL);
+    gst_object_unref(pad);
+    return TRUE;
+}
+
+gboolean load_shedder_watch(GstElement *element)
+{
+    GstPad *pad = gst_element_get_static_pad(element, "src");
+    if (!pad)
+    {
+        g_print("load shedder: src pad not found\n");
+        return FALSE;
+    }
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, _watch_probe, NULL, NULL);
+    gst_object_unref(pad);
+    return TRUE;
+}
+
+guint load_shedder_get_level(void)
+{
+    return g_atomic_int_get(&g_level);
+}
+
+void load_shedder_reset(void)
+{
+    g_mutex_lock(&g_shedder_mutex);
+    g_atomic_int_set(&g_level, 0);
+    g_late_cnt = 0;
+    g_ok_cnt = 0;
+    g_mutex_unlock(&g_shedder_mutex);
+}
@@ -0,0 +1,133 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   Two level mask pyramid for coarse to fine box coverage. Most boxes are clearly
+ *          on one side of the threshold, their coverage is decided from the cell counts
+ *          of the coarse level alone. Boxes near the threshold are refined at full
+ *          resolution, only the cells cut by the box border are counted pixel by pixel.
+ * 
+ */
+
+#include <string.h>
+#include "ds_mask_pyramid.h"
+
+void mask_pyramid_build(MaskPyramid *pyramid, const gint *class_map, guint width, guint height)
+{
+    pyramid->class_map = class_map;
+    pyramid->width = width;
+    pyramid->height = height;
+    pyramid->cols = (width + MASK_PYRAMID_CELL - 1) / MASK_PYRAMID_CELL;
+    pyramid->rows = (height + MASK_PYRAMID_CELL - 1) / MASK_PYRAMID_CELL;
+
+    guint num_cells = pyramid->cols * pyramid->rows;
+    if (num_cells > pyramid->capacity)
+    {
+        pyramid->counts = g_renew(guint, pyramid->counts, num_cells);
+        pyramid->capacity = num_cells;
+    }
+    memset(pyramid->counts, 0, num_cells * sizeof(guint));
+
+    for (guint y = 0; y < height; y++)
+    {
+        const gint *row = class_map + y * width;
+        guint *cell_row = pyramid->counts + (y / MASK_PYRAMID_CELL) * pyramid->cols;
+        for (guint x = 0; x < width; x++)
+            cell_row[x / MASK_PYRAMID_CELL] += (row[x] > 0);
+    }
+}
+
+void mask_pyramid_free(MaskPyramid *pyramid)
+{
+    g_free(pyramid->counts);
+    memset(pyramid, 0, sizeof(*pyramid));
+}
+
+static guint _count_pixels(MaskPyramid *pyramid, gint x0, gint y0, gint x1, gint y1)
+{
+    guint count = 0;
+    for (gint y = y0; y < y1; y++)
+    {
+        const gint *row = pyramid->class_map + y * pyramid->width;
+        for (gint x = x0; x < x1; x++)
+            count += (row[x] > 0);
+    }
+    return count;
+}
+
+gdouble mask_pyramid_coverage(MaskPyramid *pyramid, gint x0, gint y0, gint x1, gint y1,
+    gdouble threshold, gboolean *refined)
+{
+    x0 = MAX(x0, 0);
+    y0 = MAX(y0, 0);
+    x1 = MIN(x1, (gint) pyramid->width);
+    y1 = MIN(y1, (gint) pyramid->height);
+    *refined = FALSE;
+    if ((x1 <= x0) || (y1 <= y0))
+        return 0;
+
+    gdouble area = (gdouble) (x1 - x0) * (y1 - y0);
+    guint64 lower = 0, upper = 0;
+    gint col0 = x0 / MASK_PYRAMID_CELL, col1 = (x1 - 1) / MASK_PYRAMID_CELL;
+    gint row0 = y0 / MASK_PYRAMID_CELL, row1 = (y1 - 1) / MASK_PYRAMID_CELL;
+
+    /* A cell partly inside the box holds between count minus its outside area and
+     * count, at most the inside area, foreground pixels inside the box */
+    for (gint row = row0; row <= row1; row++)
+    {
+        gint cy0 = row * MASK_PYRAMID_CELL, cy1 = MIN(cy0 + MASK_PYRAMID_CELL, (gint) pyramid->height);
+        gint inside_h = MIN(cy1, y1) - MAX(cy0, y0);
+        for (gint col = col0; col <= col1; col++)
+        {
+            gint cx0 = col * MASK_PYRAMID_CELL, cx1 = MIN(cx0 + MASK_PYRAMID_CELL, (gint) pyramid->width);
+            gint inside = (MIN(cx1, x1) - MAX(cx0, x0)) * inside_h;
+            gint outside = (cx1 - cx0) * (cy1 - cy0) - inside;
+            gint count = pyramid->counts[row * pyramid->cols + col];
+            lower += MAX(0, count - outside);
+            upper += MIN(count, inside);
+        }
+    }
+
+    if (upper < threshold * area)
+        return upper / area;
+    if (lower >= threshold * area)
+        return lower / area;
+
+    /* Bounds straddle the threshold, count border cells at full resolution */
+    guint64 exact = 0;
+    for (gint row = row0; row <= row1; row++)
+    {
+        gint cy0 = row * MASK_PYRAMID_CELL, cy1 = MIN(cy0 + MASK_PYRAMID_CELL, (gint) pyramid->height);
+        for (gint col = col0; col <= col1; col++)
+        {
+            gint cx0 = col * MASK_PYRAMID_CELL, cx1 = MIN(cx0 + MASK_PYRAMID_CELL, (gint) pyramid->width);
+            if ((cx0 >= x0) && (cx1 <= x1) && (cy0 >= y0) && (cy1 <= y1))
+                exact += pyramid->counts[row * pyramid->cols + col];
+            else
+                exact += _count_pixels(pyramid, MAX(cx0, x0), MAX(cy0, y0), MIN(cx1, x1), MIN(cy1, y1));
+        }
+    }
+    *refined = TRUE;
+    return exact / area;
+}
@@ -0,0 +1,205 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * 
+ * @brief   Implements simple HTTP server exposing application metrics in Prometheus text format.
+ *          Metrics are formatted by the application callback on the server thread at scrape time,
+ *          streaming threads only update counters.
+ * 
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/ip.h>
+#include "glib.h"
+#include "ds_metrics_server.h"
+
+#define DEFAULT_METRICS_PORT     43435
+#define MAX_REQUEST_LEN          (4 * 1024)
+/* An idle or slow client must not hold the server thread */
+#define CLIENT_TIMEOUT_S         2
+
+#define HTTP_RESPONSE_HEADER \
+    "HTTP/1.0 200 OK\r\n" \
+    "Content-Type: text/plain; version=0.0.4\r\n" \
+    "Content-Length: %" G_GSIZE_FORMAT "\r\n" \
+    "Connection: close\r\n\r\n"
+
+struct metrics_server_info
+{
+    metrics_callback metrics_cb;
+};
+
+static gint g_metrics_port = -1;
+static gboolean g_stop_metrics_server = FALSE;
+static GMutex g_stop_metrics_server_mutex;
+
+static gboolean _write_bytes(gint fd, const gchar *buffer, gsize write_len)
+{
+    gsize len = 0;
+    while (len < write_len)
+    {
+        gssize ret = write(fd, buffer + len, write_len - len);
+        if (ret <= 0)
+        {
+            if ((ret < 0) && (errno == EINTR))
+                continue;
+            return FALSE;
+        }
+        len += ret;
+    }
+    return TRUE;
+}
+
+/* Reads the request until end of headers. Request line is not checked,
+ * every request gets the metrics. */
+static void _read_request(gint fd)
+{
+    gchar request[MAX_REQUEST_LEN + 1] = {0,};
+    gsize len = 0;
+    while (len < MAX_REQUEST_LEN)
+    {
+        gssize ret = read(fd, request + len, MAX_REQUEST_LEN - len);
+        if (ret <= 0)
+            return;
+        len += ret;
+        if (g_strstr_len(request, len, "\r\n\r\n"))
+            return;
+    }
+}
+
+static void _serve_metrics(gint fd, metrics_callback cb)
+{
+    _read_request(fd);
+
+    GString *body = g_string_new(NULL);
+    cb(body);
+
+    gchar *header = g_strdup_printf(HTTP_RESPONSE_HEADER, body->len);
+    if (_write_bytes(fd, header, strlen(header)))
+        _write_bytes(fd, body->str, body->len);
+
+    g_free(header);
+    g_string_free(body, TRUE);
+}
+
+/* Server task to serve metrics */
+static gpointer _metrics_server_task(gpointer arg)
+{
+    gint sockfd;
+    struct sockaddr_in servaddr;
+    gint reuse = 1;
+
+    struct metrics_server_info *info = (struct metrics_server_info *) arg;
+
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd == -1) {
+        g_print("metrics socket creation failed...\n");
+        free(info);
+        return NULL;
+    }
+
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    int flags = fcntl(sockfd, F_GETFL);
+    fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+
+    memset(&servaddr, 0, sizeof(servaddr));
+
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    servaddr.sin_port = htons(g_metrics_port);
+
+    if ((bind(sockfd, (struct sockaddr *) &servaddr, sizeof(servaddr)) != 0) ||
+        (listen(sockfd, 4) != 0)) {
+        g_print("metrics socket bind failed, port: %d\n", g_metrics_port);
+        close(sockfd);
+        free(info);
+        return NULL;
+    }
+
+    g_mutex_lock(&g_stop_metrics_server_mutex);
+    while(!g_stop_metrics_server)
+    {
+        g_mutex_unlock(&g_stop_metrics_server_mutex);
+
+        gint connfd = accept(sockfd, NULL, NULL);
+        if (connfd == -1)
+        {
+            if ((errno != EWOULDBLOCK) && (errno != EAGAIN))
+                g_print("metrics server accept failed...\n");
+            g_usleep (10000); /* no waiting connections. Wait for 10ms before checking again */
+            g_mutex_lock (&g_stop_metrics_server_mutex);
+            continue;
+        }
+
+        /* Accepted socket may inherit O_NONBLOCK, serve it in blocking mode
+         * with a timeout */
+        flags = fcntl(connfd, F_GETFL);
+        fcntl(connfd, F_SETFL, flags & ~O_NONBLOCK);
+        struct timeval timeout = { CLIENT_TIMEOUT_S, 0 };
+        setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(connfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        _serve_metrics(connfd, info->metrics_cb);
+
+        close(connfd);
+        g_mutex_lock (&g_stop_metrics_server_mutex);
+    }
+    g_mutex_unlock(&g_stop_metrics_server_mutex);
+
+    close(sockfd);
+    free(info);
+    return NULL;
+}
+
+void start_metrics_server(metrics_callback cb)
+{
+    g_stop_metrics_server = FALSE;
+    /* mutex to stop the server from a different thread. */
+    g_mutex_init (&g_stop_metrics_server_mutex);
+
+#ifdef DS_APP_METRICS_PORT
+    g_metrics_port = DS_APP_METRICS_PORT;
+#else
+    g_metrics_port = DEFAULT_METRICS_PORT;
+#endif
+
+    struct metrics_server_info *info = (struct metrics_server_info *) malloc(sizeof(struct metrics_server_info));
+    info->metrics_cb = cb;
+
+    /* Start the server task. */
+    GThread *g_metrics_thread = g_thread_new ("DS app metrics server thread", _metrics_server_task, (gpointer) info);
+    g_thread_unref (g_metrics_thread);
+}
+
+void stop_metrics_server(void)
+{
+    g_mutex_lock(&g_stop_metrics_server_mutex);
+    g_stop_metrics_server = TRUE;
+    g_mutex_unlock(&g_stop_metrics_server_mutex);
+}
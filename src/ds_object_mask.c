@@ -0,0 +1,256 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   Composes per object segmentation masks into a frame level class map so
+ *          the frame level mIoU check of fpfilter can use a segmentation assessor
+ *          which runs on object crops. Only the box area of each object is written,
+ *          masks are sampled nearest neighbour from box local to map coordinates.
+ *          The class map comes with a class probability map of the same layout as
+ *          nvinfer's, since fpfilter may read either.
+ * 
+ */
+
+#include <string.h>
+#include "gstnvdsinfer.h"
+#include "ds_object_mask.h"
+
+static NvDsInferSegmentationMeta *_find_seg_meta(NvDsUserMetaList *user_meta_list)
+{
+    for (NvDsUserMetaList *l_user = user_meta_list; l_user != NULL; l_user = l_user->next)
+    {
+        NvDsUserMeta *user_meta = (NvDsUserMeta *) l_user->data;
+        if (user_meta->base_meta.meta_type == NVDSINFER_SEGMENTATION_META)
+            return (NvDsInferSegmentationMeta *) user_meta->user_meta_data;
+    }
+    return NULL;
+}
+
+/* Frame map with the region written since it was last cleared. Maps are pooled since
+ * every frame needs one, and only the written region is cleared for reuse instead of
+ * allocating and zero filling the whole map again. */
+typedef struct {
+    NvDsInferSegmentationMeta meta;
+    gint x0, y0, x1, y1;
+} FrameMask;
+
+#define FRAME_MASK_POOL_SIZE    64
+
+static GMutex g_pool_mutex;
+static GSList *g_pool = NULL;
+static guint g_pool_len = 0;
+
+static void _free_frame_mask(FrameMask *mask)
+{
+    g_free(mask->meta.class_map);
+    g_free(mask->meta.class_probabilities_map);
+    g_free(mask);
+}
+
+/* Background is class 0 with probability 1 */
+static void _clear_region(FrameMask *mask)
+{
+    NvDsInferSegmentationMeta *meta = &mask->meta;
+    for (gint y = mask->y0; y < mask->y1; y++)
+    {
+        memset(meta->class_map + y * meta->width + mask->x0, 0, (mask->x1 - mask->x0) * sizeof(gint));
+        for (guint c = 0; c < meta->classes; c++)
+        {
+            gfloat *row = meta->class_probabilities_map + (c * meta->height + y) * meta->width;
+            for (gint x = mask->x0; x < mask->x1; x++)
+                row[x] = (c == 0) ? 1.0f : 0.0f;
+        }
+    }
+    mask->x0 = mask->y0 = mask->x1 = mask->y1 = 0;
+}
+
+static FrameMask *_acquire_frame_mask(guint classes, guint width, guint height)
+{
+    FrameMask *mask = NULL;
+
+    g_mutex_lock(&g_pool_mutex);
+    while (g_pool && !mask)
+    {
+        FrameMask *pooled = (FrameMask *) g_pool->data;
+        g_pool = g_slist_delete_link(g_pool, g_pool);
+        g_pool_len--;
+        if ((pooled->meta.classes == classes) && (pooled->meta.width == width) && (pooled->meta.height == height))
+            mask = pooled;
+        else
+            _free_frame_mask(pooled);
+    }
+    g_mutex_unlock(&g_pool_mutex);
+
+    if (!mask)
+    {
+        mask = g_new0(FrameMask, 1);
+        mask->meta.classes = classes;
+        mask->meta.width = width;
+        mask->meta.height = height;
+        mask->meta.class_map = g_new0(gint, width * height);
+        mask->meta.class_probabilities_map = g_new0(gfloat, classes * width * height);
+        if (classes)
+        {
+            for (guint idx = 0; idx < width * height; idx++)
+                mask->meta.class_probabilities_map[idx] = 1.0f;
+        }
+    }
+    return mask;
+}
+
+static void _release_seg_meta(gpointer data, gpointer user_data)
+{
+    NvDsUserMeta *user_meta = (NvDsUserMeta *) data;
+    FrameMask *mask = (FrameMask *) user_meta->user_meta_data;
+    user_meta->user_meta_data = NULL;
+
+    _clear_region(mask);
+    g_mutex_lock(&g_pool_mutex);
+    if (g_pool_len < FRAME_MASK_POOL_SIZE)
+    {
+        g_pool = g_slist_prepend(g_pool, mask);
+        g_pool_len++;
+        mask = NULL;
+    }
+    g_mutex_unlock(&g_pool_mutex);
+    if (mask)
+        _free_frame_mask(mask);
+}
+
+static gpointer _copy_seg_meta(gpointer data, gpointer user_data)
+{
+    NvDsUserMeta *user_meta = (NvDsUserMeta *) data;
+    FrameMask *src = (FrameMask *) user_meta->user_meta_data;
+    FrameMask *dst = _acquire_frame_mask(src->meta.classes, src->meta.width, src->meta.height);
+    guint pixels = src->meta.width * src->meta.height;
+
+    memcpy(dst->meta.class_map, src->meta.class_map, pixels * sizeof(gint));
+    memcpy(dst->meta.class_probabilities_map, src->meta.class_probabilities_map,
+        src->meta.classes * pixels * sizeof(gfloat));
+    dst->x0 = 0;
+    dst->y0 = 0;
+    dst->x1 = src->meta.width;
+    dst->y1 = src->meta.height;
+    return dst;
+}
+
+/* Writes foreground classes of the object mask into the box area of the frame map.
+ * Background never overwrites a foreground class written by an overlapping object.
+ * Probabilities come from the object mask, or are one hot if it has none. */
+static void _paste_object_mask(FrameMask *mask, NvDsInferSegmentationMeta *obj_mask,
+    NvOSD_RectParams *rect, gdouble scale_x, gdouble scale_y)
+{
+    NvDsInferSegmentationMeta *frame_mask = &mask->meta;
+    if ((rect->width <= 0) || (rect->height <= 0) || !obj_mask->class_map)
+        return;
+
+    gint x0 = MAX(0, (gint) (rect->left * scale_x));
+    gint y0 = MAX(0, (gint) (rect->top * scale_y));
+    gint x1 = MIN((gint) frame_mask->width, (gint) ((rect->left + rect->width) * scale_x));
+    gint y1 = MIN((gint) frame_mask->height, (gint) ((rect->top + rect->height) * scale_y));
+    gdouble box_width = rect->width * scale_x;
+    gdouble box_height = rect->height * scale_y;
+    if ((x0 >= x1) || (y0 >= y1))
+        return;
+
+    if (mask->x0 >= mask->x1)
+    {
+        mask->x0 = x0;
+        mask->y0 = y0;
+        mask->x1 = x1;
+        mask->y1 = y1;
+    }
+    else
+    {
+        mask->x0 = MIN(mask->x0, x0);
+        mask->y0 = MIN(mask->y0, y0);
+        mask->x1 = MAX(mask->x1, x1);
+        mask->y1 = MAX(mask->y1, y1);
+    }
+
+    gboolean has_probabilities = obj_mask->class_probabilities_map && (obj_mask->classes == frame_mask->classes);
+    guint obj_pixels = obj_mask->width * obj_mask->height;
+    guint frame_pixels = frame_mask->width * frame_mask->height;
+    for (gint y = y0; y < y1; y++)
+    {
+        guint my = MIN(obj_mask->height - 1, (guint) ((y - rect->top * scale_y) * obj_mask->height / box_height));
+        gint *src_row = obj_mask->class_map + my * obj_mask->width;
+        gint *dst_row = frame_mask->class_map + y * frame_mask->width;
+        for (gint x = x0; x < x1; x++)
+        {
+            guint mx = MIN(obj_mask->width - 1, (guint) ((x - rect->left * scale_x) * obj_mask->width / box_width));
+            if (src_row[mx] <= 0)
+                continue;
+            dst_row[x] = src_row[mx];
+            for (guint c = 0; c < frame_mask->classes; c++)
+            {
+                frame_mask->class_probabilities_map[c * frame_pixels + y * frame_mask->width + x] = has_probabilities ?
+                    obj_mask->class_probabilities_map[c * obj_pixels + my * obj_mask->width + mx] :
+                    ((gint) c == src_row[mx]) ? 1.0f : 0.0f;
+            }
+        }
+    }
+}
+
+guint object_mask_compose_frame_masks(NvDsBatchMeta *batch_meta, guint frame_width, guint frame_height,
+    guint map_width, guint map_height)
+{
+    guint composed = 0;
+    gdouble scale_x = (gdouble) map_width / frame_width;
+    gdouble scale_y = (gdouble) map_height / frame_height;
+
+    for (NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next)
+    {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        FrameMask *frame_mask = NULL;
+
+        if (_find_seg_meta(frame_meta->frame_user_meta_list))
+            continue;
+
+        for (NvDsMetaList *l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next)
+        {
+            NvDsObjectMeta *obj = (NvDsObjectMeta *) l_obj->data;
+            NvDsInferSegmentationMeta *obj_mask = _find_seg_meta(obj->obj_user_meta_list);
+            if (!obj_mask)
+                continue;
+
+            /* Frame map is taken lazily, background is class 0 */
+            if (!frame_mask)
+                frame_mask = _acquire_frame_mask(obj_mask->classes, map_width, map_height);
+            _paste_object_mask(frame_mask, obj_mask, &obj->rect_params, scale_x, scale_y);
+        }
+
+        if (!frame_mask)
+            continue;
+
+        NvDsUserMeta *user_meta = nvds_acquire_user_meta_from_pool(batch_meta);
+        user_meta->user_meta_data = frame_mask;
+        user_meta->base_meta.meta_type = NVDSINFER_SEGMENTATION_META;
+        user_meta->base_meta.copy_func = _copy_seg_meta;
+        user_meta->base_meta.release_func = _release_seg_meta;
+        nvds_add_user_meta_to_frame(frame_meta, user_meta);
+        composed++;
+    }
+    return composed;
+}
@@ -0,0 +1,65 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+
+/**
+ * 
+ * @brief   Matches batches between two pads by PTS, shared by the latency tracer
+ *          and the load shedder.
+ * 
+ */
+
+#include <string.h>
+#include "ds_pending_batches.h"
+
+void pending_batches_init(PendingBatches *pending)
+{
+    memset(pending, 0, sizeof(*pending));
+    g_mutex_init(&pending->lock);
+}
+
+void pending_batches_push(PendingBatches *pending, GstClockTime pts, gint64 time_us)
+{
+    g_mutex_lock(&pending->lock);
+    pending->pts[pending->next] = pts;
+    pending->time_us[pending->next] = time_us;
+    pending->next = (pending->next + 1) % MAX_PENDING_BATCHES;
+    g_mutex_unlock(&pending->lock);
+}
+
+gint64 pending_batches_find(PendingBatches *pending, GstClockTime pts)
+{
+    gint64 time_us = 0;
+    g_mutex_lock(&pending->lock);
+    for (guint cnt = 1; cnt <= MAX_PENDING_BATCHES; cnt++)
+    {
+        guint idx = (pending->next + MAX_PENDING_BATCHES - cnt) % MAX_PENDING_BATCHES;
+        if (pending->time_us[idx] && (pending->pts[idx] == pts))
+        {
+            time_us = pending->time_us[idx];
+            break;
+        }
+    }
+    g_mutex_unlock(&pending->lock);
+    return time_us;
+}
@@ -29,10 +29,14 @@
 
 #include <unistd.h>
 #include "ds_save_frame.h"
+#include "ds_async_log.h"
 
 static gboolean g_stop_save_frame_thread = FALSE;
 static GMutex g_stop_save_frame_thread_mutex;
 static GAsyncQueue *g_frames_queue = NULL;
+static gint g_saved_frame_count = 0;
+/* Milliseconds spent in the save script, which also uploads */
+static gint g_upload_time_ms = 0;
 
 /* task to save frames */
 static gpointer
@@ -48,9 +52,13 @@ _save_frame_task(gpointer arg)
             FrameInfo *frame_info = (FrameInfo *) g_async_queue_pop (g_frames_queue);
             gchar cmd[1024] = {0,};
             g_snprintf(cmd, 1024, "%s %s %d %d", "./src/save_image.sh", frame_info->source, frame_info->pad_index, frame_info->frame_index);
-            g_print("saving: %s %d %d\n", frame_info->source, frame_info->pad_index, frame_info->frame_index);
+            ASYNC_LOG(ASYNC_LOG_FRAME, "saving: stream %" G_GINT64_FORMAT " frame %" G_GINT64_FORMAT "\n",
+                frame_info->pad_index, frame_info->frame_index);
+            gint64 start_us = g_get_monotonic_time();
             system(cmd);
+            g_atomic_int_add(&g_upload_time_ms, (gint) ((g_get_monotonic_time() - start_us) / 1000));
             free(frame_info);
+            g_atomic_int_inc(&g_saved_frame_count);
         }
 
         usleep(1000); /* Sleep for 1ms until next frames are availble */
@@ -87,3 +95,15 @@ stop_save_frame_task(void)
     g_mutex_unlock(&g_stop_save_frame_thread_mutex);
 }
 
+guint
+get_saved_frame_count(void)
+{
+    return (guint) g_atomic_int_get(&g_saved_frame_count);
+}
+
+gdouble
+get_upload_time_s(void)
+{
+    return g_atomic_int_get(&g_upload_time_ms) / 1000.0;
+}
+
@@ -23,6 +23,8 @@
 /**
  * 
  * @brief   Implements simple server to handle user prompts. Reads message from user and invokes application callback with message.
+ *          A client can send several messages over one connection, every message is acknowledged with "ok",
+ *          or with the reason the callback gave when it rejected the message.
  * 
  */
 
@@ -32,12 +34,18 @@
 #include <errno.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <netinet/ip.h>
+#include <arpa/inet.h>
 #include "glib.h"
 #include "ds_usr_prompt_handler.h"
+#include "ds_async_log.h"
 
 #define DEFAULT_MONITOR_PORT     43434
 #define MAX_PACKET_LEN          (4 * 1024)
+/* Idle connections are closed after this time so other clients get their turn */
+#define CONNECTION_TIMEOUT_S     5
+#define USR_PROMPT_ACK          "ok"
 
 struct usr_prompt_info
 {
@@ -48,27 +56,62 @@ static gint g_server_port = -1;
 static gboolean g_stop_server = FALSE;
 static GMutex g_stop_server_mutex;
 
-static void _read_bytes(gint fd, guint read_len, guchar *buffer)
+/* Returns FALSE when the client closed the connection, timed out or failed */
+static gboolean _read_bytes(gint fd, guint read_len, guchar *buffer)
 {
     guint len = 0;
     while (len < read_len)
     {
-        len += read(fd, buffer + len, read_len - len);
+        ssize_t ret = read(fd, buffer + len, read_len - len);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return FALSE;
+        len += ret;
     }
+    return TRUE;
 }
 
-static guint _read_message(gint fd, guchar *msg)
+static gboolean _read_message(gint fd, guchar *msg, guint *msg_len)
 {
-    g_print("reading user message\n");
     /* First read len of the message */
     guchar len_buff[2] = {0,};
-    _read_bytes(fd, 2, len_buff);
+    if (!_read_bytes(fd, 2, len_buff))
+        return FALSE;
     guint16 len = 0;
     memcpy(&len, len_buff, 2);
+    if (len >= MAX_PACKET_LEN)
+    {
+        g_print("user message too long: %u\n", len);
+        return FALSE;
+    }
 
     /* read message */
-    _read_bytes(fd, len, msg);
-    return (guint) len;
+    if (!_read_bytes(fd, len, msg))
+        return FALSE;
+    *msg_len = len;
+    return TRUE;
+}
+
+static gboolean _send_ack(gint fd, const gchar *status)
+{
+    guchar ack[MAX_PACKET_LEN] = {0,};
+    guint16 len = MIN(strlen(status), MAX_PACKET_LEN - 3);
+    memcpy(ack, &len, 2);
+    memcpy(ack + 2, status, len);
+
+    guint sent_len = 0;
+    while (sent_len < 2u + len)
+    {
+        /* Older clients close without reading the ack, avoid SIGPIPE */
+        ssize_t ret = send(fd, ack + sent_len, 2 + len - sent_len, MSG_NOSIGNAL);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0)
+            return FALSE;
+        sent_len += ret;
+    }
+    return TRUE;
 }
 
 /* Server task to monitor for user prompts */
@@ -94,6 +137,17 @@ static gpointer _server_task(gpointer arg)
     servaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
     servaddr.sin_port = htons(g_server_port);
 
+    /* Fleet managers on other hosts need the server on a non loopback address */
+    const gchar *addr = g_getenv(USR_PROMPT_ADDR_ENV);
+    if (addr && (inet_pton(AF_INET, addr, &servaddr.sin_addr) != 1))
+    {
+        g_print("invalid %s: %s\n", USR_PROMPT_ADDR_ENV, addr);
+        return NULL;
+    }
+    if ((ntohl(servaddr.sin_addr.s_addr) >> 24) != 127)
+        g_printerr("WARNING: user prompts accepted on %s:%d without authentication, "
+            "anyone reaching this address can control the pipeline\n", addr, g_server_port);
+
     if (bind(sockfd, (struct sockaddr *) &servaddr, sizeof(servaddr)) != 0) { 
         g_print("socket bind failed, port: %d\n", g_server_port);
         return NULL;
@@ -132,14 +186,26 @@ static gpointer _server_task(gpointer arg)
             }
         }
 
-        g_print("accepting connection success\n");
+        ASYNC_LOG(ASYNC_LOG_DEBUG, "accepting connection success\n");
 
+        struct timeval timeout = { CONNECTION_TIMEOUT_S, 0 };
+        setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(connfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        /* Serve messages until the client closes the connection */
         guchar msg[MAX_PACKET_LEN] = {0,};
-        guint msg_len = _read_message(connfd, msg);
-        g_print("read message success\n");
+        guint msg_len = 0;
+        while (_read_message(connfd, msg, &msg_len))
+        {
+            ASYNC_LOG(ASYNC_LOG_DEBUG, "read message success\n");
+            msg[msg_len] = '\0';
 
-        // Trigger application callback with message.
-        info->msg_cb(msg, msg_len);
+            // Trigger application callback with message.
+            const gchar *error = info->msg_cb(msg, msg_len);
+
+            if (!_send_ack(connfd, error ? error : USR_PROMPT_ACK))
+                break;
+        }
 
         close(connfd);
         g_mutex_lock (&g_stop_server_mutex);
@@ -163,6 +229,17 @@ void start_usr_prompt_monitor(user_prompt_callback cb)
 #else
     g_server_port = DEFAULT_MONITOR_PORT;
 #endif
+    /* Several apps on one host need their own ports */
+    const gchar *port = g_getenv(USR_PROMPT_PORT_ENV);
+    if (port)
+    {
+        gchar *end = NULL;
+        guint64 value = g_ascii_strtoull(port, &end, 10);
+        if ((end == port) || *end || (value == 0) || (value > G_MAXUINT16))
+            g_printerr("invalid %s: %s, using port %d\n", USR_PROMPT_PORT_ENV, port, g_server_port);
+        else
+            g_server_port = (gint) value;
+    }
 
     struct usr_prompt_info *info = (struct usr_prompt_info *) malloc(sizeof(struct usr_prompt_info));
     info->msg_cb = cb;
@@ -0,0 +1,195 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * 
+ * @brief   CPU only checks of the branch merge. fakesrc feeds a tee, identity elements
+ *          stand in for assessors and tag every buffer they handle, like assessors
+ *          attach their metadata to the batch. The output branch must only push
+ *          buffers carrying the tags of all branches, and drop buffers the branches
+ *          never finish.
+ * 
+ *          Built with a short BRANCH_MERGE_TIMEOUT_US, run with "make test".
+ * 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gst/gst.h>
+#include "ds_branch_merge.h"
+
+#define NUM_BRANCHES    2
+#define NUM_BUFFERS     50
+
+static GQuark g_branch_quarks[NUM_BRANCHES];
+static gint g_out_buffers = 0;
+static gint g_out_complete = 0;
+
+/* Fake assessor: marks the shared buffer as processed by its branch */
+static void
+_branch_handoff(GstElement *identity, GstBuffer *buf, gpointer user_data)
+{
+    guint branch = GPOINTER_TO_UINT(user_data);
+    gst_mini_object_set_qdata(GST_MINI_OBJECT(buf), g_branch_quarks[branch], GUINT_TO_POINTER(1), NULL);
+}
+
+static void
+_out_handoff(GstElement *sink, GstBuffer *buf, GstPad *pad, gpointer user_data)
+{
+    gboolean complete = TRUE;
+    for (guint idx = 0; idx < NUM_BRANCHES; idx++)
+        complete = complete && gst_mini_object_get_qdata(GST_MINI_OBJECT(buf), g_branch_quarks[idx]);
+    g_atomic_int_inc(&g_out_buffers);
+    if (complete)
+        g_atomic_int_inc(&g_out_complete);
+}
+
+static GstElement *
+_make(GstElement *pipeline, const gchar *factory, const gchar *name)
+{
+    GstElement *element = gst_element_factory_make(factory, name);
+    if (!element)
+    {
+        g_printerr("%s could not be created\n", factory);
+        exit(1);
+    }
+    gst_bin_add(GST_BIN(pipeline), element);
+    return element;
+}
+
+static GstElement *
+_make_sink(GstElement *pipeline, const gchar *name)
+{
+    GstElement *sink = _make(pipeline, "fakesink", name);
+    /* A branch dropping every buffer never prerolls its sink */
+    g_object_set(G_OBJECT(sink), "sync", FALSE, "async", FALSE, NULL);
+    return sink;
+}
+
+/* Runs fakesrc -> tee -> NUM_BRANCHES fake assessors plus the output branch.
+ * drop_branch >= 0 makes that branch drop every buffer. Returns the number of
+ * warnings posted. */
+static guint
+_run(gint drop_branch, guint num_buffers, guint64 *dropped)
+{
+    guint warnings = 0;
+    g_atomic_int_set(&g_out_buffers, 0);
+    g_atomic_int_set(&g_out_complete, 0);
+
+    GstElement *pipeline = gst_pipeline_new("test-pipeline");
+    GstElement *src = _make(pipeline, "fakesrc", "src");
+    GstElement *tee = _make(pipeline, "tee", "tee");
+    g_object_set(G_OBJECT(src), "num-buffers", num_buffers, "sizetype", 2, "sizemax", 64, NULL);
+    gst_element_link(src, tee);
+
+    BranchMerge *merge = branch_merge_new("test-merge", NUM_BRANCHES);
+    for (guint idx = 0; idx < NUM_BRANCHES; idx++)
+    {
+        gchar name[32];
+        g_snprintf(name, sizeof(name), "queue-%u", idx);
+        GstElement *queue = _make(pipeline, "queue", name);
+        g_snprintf(name, sizeof(name), "assessor-%u", idx);
+        GstElement *assessor = _make(pipeline, "identity", name);
+        g_snprintf(name, sizeof(name), "sink-%u", idx);
+        GstElement *sink = _make_sink(pipeline, name);
+
+        /* Branches are slower than the output branch, so the merge has to wait */
+        g_object_set(G_OBJECT(assessor), "sleep-time", 2000 * (idx + 1), NULL);
+        if ((gint) idx == drop_branch)
+            g_object_set(G_OBJECT(assessor), "drop-probability", 1.0, NULL);
+        g_signal_connect(assessor, "handoff", G_CALLBACK(_branch_handoff), GUINT_TO_POINTER(idx));
+        gst_element_link_many(tee, queue, assessor, sink, NULL);
+        branch_merge_add_branch(merge, idx, assessor);
+    }
+
+    GstElement *out_queue = _make(pipeline, "queue", "queue-out");
+    GstElement *out = _make(pipeline, "identity", "out");
+    GstElement *out_sink = _make_sink(pipeline, "sink-out");
+    g_object_set(G_OBJECT(out_sink), "signal-handoffs", TRUE, NULL);
+    g_signal_connect(out_sink, "handoff", G_CALLBACK(_out_handoff), NULL);
+    gst_element_link_many(tee, out_queue, out, out_sink, NULL);
+    branch_merge_set_output(merge, out);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    gboolean done = FALSE;
+    while (!done)
+    {
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, 30 * GST_SECOND,
+            GST_MESSAGE_EOS | GST_MESSAGE_ERROR | GST_MESSAGE_WARNING);
+        if (!msg)
+        {
+            g_printerr("pipeline did not finish\n");
+            break;
+        }
+        if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_WARNING)
+            warnings++;
+        else
+            done = (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+        if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+        {
+            g_printerr("pipeline error\n");
+            break;
+        }
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    *dropped = branch_merge_get_dropped(merge);
+    gst_object_unref(pipeline);
+    branch_merge_free(merge);
+    return warnings;
+}
+
+static gboolean
+_check(gboolean condition, const gchar *what)
+{
+    g_print("%s: %s\n", condition ? "PASS" : "FAIL", what);
+    return condition;
+}
+
+int
+main(int argc, char *argv[])
+{
+    gboolean ok = TRUE;
+    guint64 dropped = 0;
+
+    gst_init(&argc, &argv);
+    for (guint idx = 0; idx < NUM_BRANCHES; idx++)
+    {
+        gchar name[32];
+        g_snprintf(name, sizeof(name), "test-branch-%u", idx);
+        g_branch_quarks[idx] = g_quark_from_string(name);
+    }
+
+    guint warnings = _run(-1, NUM_BUFFERS, &dropped);
+    ok &= _check(g_atomic_int_get(&g_out_buffers) == NUM_BUFFERS, "every buffer leaves the merge");
+    ok &= _check(g_atomic_int_get(&g_out_complete) == NUM_BUFFERS, "every output buffer has all branch results");
+    ok &= _check((dropped == 0) && (warnings == 0), "nothing dropped while branches keep up");
+
+    warnings = _run(NUM_BRANCHES - 1, 3, &dropped);
+    ok &= _check(g_atomic_int_get(&g_out_buffers) == 0, "no incomplete buffer leaves the merge");
+    ok &= _check((dropped == 3) && (warnings == 3), "stalled branch drops every buffer with a warning");
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/*###############################################################################
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+*/
+
+
+
+/**
+ * 
+ * @brief   CPU only checks of ds-fpfilter-manager against the user prompt server.
+ *          The real server runs in this process with a callback rejecting some
+ *          messages, a stub server on a second port acks everything. The manager
+ *          must send every message to both targets, and report the reason of a
+ *          rejected message instead of treating it as acked.
+ * 
+ *          Takes the manager binary as argument, run with "make test".
+ * 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/ip.h>
+#include <arpa/inet.h>
+#include "glib.h"
+#include <glib/gstdio.h>
+#include "ds_usr_prompt_handler.h"
+
+#define MAX_PACKET_LEN          (4 * 1024)
+#define REJECT_REASON           "unknown source"
+
+static gint g_server_messages = 0;
+static gint g_stub_messages = 0;
+
+static const gchar *
+_prompt_cb(guchar *msg, guint len)
+{
+    g_atomic_int_inc(&g_server_messages);
+    return strstr((const gchar *) msg, "reject") ? REJECT_REASON : NULL;
+}
+
+static gboolean
+_read_all(gint fd, guchar *buffer, gsize len)
+{
+    gsize read_len = 0;
+    while (read_len < len)
+    {
+        ssize_t ret = read(fd, buffer + read_len, len - read_len);
+        if (ret <= 0)
+            return FALSE;
+        read_len += ret;
+    }
+    return TRUE;
+}
+
+/* Serves one connection like the prompt server, acking every message */
+static gpointer
+_stub_task(gpointer arg)
+{
+    gint sockfd = GPOINTER_TO_INT(arg);
+    gint connfd = accept(sockfd, NULL, NULL);
+    if (connfd < 0)
+        return NULL;
+
+    guchar msg[MAX_PACKET_LEN];
+    guint16 len = 0;
+    while (_read_all(connfd, (guchar *) &len, 2) && (len < MAX_PACKET_LEN) && _read_all(connfd, msg, len))
+    {
+        g_atomic_int_inc(&g_stub_messages);
+        guchar ack[4] = { 0, 0, 'o', 'k' };
+        guint16 ack_len = 2;
+        memcpy(ack, &ack_len, 2);
+        if (write(connfd, ack, sizeof(ack)) != sizeof(ack))
+            break;
+    }
+    close(connfd);
+    return NULL;
+}
+
+/* Listens on a free loopback port, returns the socket */
+static gint
+_listen(guint16 *port)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    gint sockfd = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((sockfd < 0) || bind(sockfd, (struct sockaddr *) &addr, sizeof(addr)) ||
+        listen(sockfd, 1) || getsockname(sockfd, (struct sockaddr *) &addr, &len))
+    {
+        g_printerr("stub server failed\n");
+        exit(1);
+    }
+    *port = ntohs(addr.sin_port);
+    return sockfd;
+}
+
+/* The prompt server starts on its own thread, wait until it accepts */
+static gboolean
+_wait_for_server(guint16 port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    for (guint retry = 0; retry < 100; retry++)
+    {
+        gint sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        gboolean connected = (connect(sockfd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+        close(sockfd);
+        if (connected)
+            return TRUE;
+        g_usleep(10000);
+    }
+    return FALSE;
+}
+
+static gchar *
+_write_message(const gchar *dir, const gchar *name, const gchar *contents)
+{
+    gchar *path = g_build_filename(dir, name, NULL);
+    if (!g_file_set_contents(path, contents, -1, NULL))
+    {
+        g_printerr("%s could not be written\n", path);
+        exit(1);
+    }
+    return path;
+}
+
+/* Runs the manager, returns its exit code and output */
+static gint
+_run_manager(gchar **argv, gchar **output)
+{
+    gint status = 0;
+    GError *error = NULL;
+    if (!g_spawn_sync(NULL, argv, NULL, G_SPAWN_DEFAULT, NULL, NULL, output, NULL, &status, &error))
+    {
+        g_printerr("%s could not be run: %s\n", argv[0], error->message);
+        exit(1);
+    }
+    g_print("%s", *output);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static gboolean
+_check(gboolean condition, const gchar *what)
+{
+    g_print("%s: %s\n", condition ? "PASS" : "FAIL", what);
+    return condition;
+}
+
+int
+main(int argc, char *argv[])
+{
+    gboolean ok = TRUE;
+    const gchar *manager = (argc > 1) ? argv[1] : "./ds-fpfilter-manager";
+    gchar *output = NULL;
+
+    /* A free port for the prompt server, taken from a socket closed again */
+    guint16 server_port = 0;
+    close(_listen(&server_port));
+    gchar *server_port_str = g_strdup_printf("%u", server_port);
+    g_setenv(USR_PROMPT_PORT_ENV, server_port_str, TRUE);
+    start_usr_prompt_monitor(_prompt_cb);
+    if (!_wait_for_server(server_port))
+    {
+        g_printerr("prompt server did not start\n");
+        return 1;
+    }
+
+    guint16 stub_port = 0;
+    gint stub_sockfd = _listen(&stub_port);
+    GThread *stub = g_thread_new("stub prompt server", _stub_task, GINT_TO_POINTER(stub_sockfd));
+
+    gchar *dir = g_dir_make_tmp("test_usr_prompt_XXXXXX", NULL);
+    gchar *first = _write_message(dir, "first.json", "{\"command\": \"first\"}");
+    gchar *second = _write_message(dir, "second.json", "{\"command\": \"second\"}");
+    gchar *rejected = _write_message(dir, "rejected.json", "{\"command\": \"reject\"}");
+    gchar *server_target = g_strdup_printf("127.0.0.1:%u", server_port);
+    gchar *stub_target = g_strdup_printf("127.0.0.1:%u", stub_port);
+
+    gchar *fan_out_argv[] = { (gchar *) manager, "-t", server_target, "-t", stub_target,
+        "-m", first, "-m", second, NULL };
+    gint code = _run_manager(fan_out_argv, &output);
+    g_thread_join(stub);
+    close(stub_sockfd);
+    ok &= _check(code == 0, "manager succeeds when every target acks");
+    ok &= _check(strstr(output, "summary: 2/2 targets ok") != NULL, "both targets reported ok");
+    ok &= _check((g_atomic_int_get(&g_server_messages) == 2) && (g_atomic_int_get(&g_stub_messages) == 2),
+        "every message reaches every target");
+    g_free(output);
+
+    g_atomic_int_set(&g_server_messages, 0);
+    gchar *reject_argv[] = { (gchar *) manager, "-t", server_target,
+        "-m", first, "-m", rejected, "-m", second, NULL };
+    code = _run_manager(reject_argv, &output);
+    ok &= _check(code == 1, "manager fails when a message is rejected");
+    ok &= _check(strstr(output, "failed, 1/3 acked: message rejected: " REJECT_REASON) != NULL,
+        "the rejection reason is reported instead of ok");
+    ok &= _check(g_atomic_int_get(&g_server_messages) == 2, "no message is sent after the rejected one");
+    g_free(output);
+
+    stop_usr_prompt_monitor();
+    g_remove(first);
+    g_remove(second);
+    g_remove(rejected);
+    g_rmdir(dir);
+    return ok ? 0 : 1;
+}